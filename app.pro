@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2016-05-19T22:59:57
+#
+#-------------------------------------------------
+
+TARGET = darkcropper
+TEMPLATE = app
+
+include(darkcropper.pri)
+
+QT += network
+
+SOURCES += main.cpp \
+    controlserver.cpp
+
+HEADERS += controlserver.h
+
+DISTFILES += \
+    .gitignore \
+    LICENSE \
+    README.md
@@ -0,0 +1,13 @@
+# Microbenchmarks for the imaging hot paths.  Run with
+#   QT_QPA_PLATFORM=offscreen ./darkcropper-benchmarks --output results.json
+
+TARGET = darkcropper-benchmarks
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../darkcropper.pri)
+
+SOURCES += imagingbenchmark.cpp
+
+HEADERS += imagingbenchmark.h
@@ -0,0 +1,580 @@
+#include <cmath>
+#include <algorithm>
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QJsonDocument>
+#include <QPainter>
+#include <QProcess>
+#include <QResizeEvent>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include "imagingbenchmark.h"
+#include "imagewindow.h"
+#include "exportjob.h"
+#include "linearmultiply.h"
+#include "imagedecoder.h"
+
+// The most a planned export may differ from the general resampler's, as
+// compare's normalised root mean square error.  Half a pixel's shift of the
+// check picture comes to several times this.
+static const double checkTolerance = 0.01;
+
+static QTextStream &err()
+{
+    static QTextStream s(stderr);
+    return s;
+}
+
+static void resizeWindow(ImageWindow &w, QSize size)
+{
+    w.resize(size);
+    QResizeEvent ev(size, QSize());
+    QApplication::sendEvent(&w, &ev);
+}
+
+
+
+ImagingBenchmark::ImagingBenchmark()
+    : maxMegapixels(200), minimumTime(1000)
+{
+}
+
+void ImagingBenchmark::setFilter(const QString &pattern)
+{
+    filter.setPattern(pattern);
+}
+
+void ImagingBenchmark::setMaxMegapixels(int mp)
+{
+    maxMegapixels = mp;
+}
+
+void ImagingBenchmark::setMinimumTime(int msec)
+{
+    minimumTime = msec;
+}
+
+void ImagingBenchmark::run()
+{
+    checkExport();
+    benchTransform();
+    benchBackground();
+    benchMultiply();
+    for (Source &src : sources()) {
+        if (src.megapixels > maxMegapixels)
+            continue;
+        benchLoad(src);
+        benchDecode(src);
+        benchPaint(src);
+        benchExport(src);
+        if (!src.filename.isEmpty())
+            QFile(src.filename).remove();
+    }
+}
+
+QJsonObject ImagingBenchmark::results()
+{
+    QJsonObject context;
+    context["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    context["host"] = QSysInfo::machineHostName();
+    context["os"] = QSysInfo::prettyProductName();
+    context["cpu_architecture"] = QSysInfo::currentCpuArchitecture();
+    context["decoders"] = QJsonArray::fromStringList(ImageDecoder::backends());
+    context["cpu_threads"] = QThread::idealThreadCount();
+    context["qt_version"] = QString(qVersion());
+#ifdef QT_NO_DEBUG
+    context["build"] = QString("release");
+#else
+    context["build"] = QString("debug");
+#endif
+    context["min_time_ms"] = minimumTime;
+
+    QJsonObject root;
+    root["context"] = context;
+    root["benchmarks"] = entries;
+    return root;
+}
+
+void ImagingBenchmark::benchTransform()
+{
+    QString name = "transform/ImageCropping";
+    if (!selected(name))
+        return;
+    ImageCropping ic;
+    ic.scaling = 0.75;
+    ic.rotation = 12.5;
+    ic.translation = QPointF(31.5, -12.25);
+    volatile qreal sink = 0;
+    const int batch = 10000;
+    measure(name, QJsonObject(), [&]() {
+        for (int i = 0; i < batch; i++)
+            sink = sink + ic.transform(1.0 + i * 1e-6).m11();
+    }, batch);
+}
+
+void ImagingBenchmark::benchBackground()
+{
+    for (QSize size : { QSize(1920, 1080), QSize(3840, 2160) }) {
+        QString name = QString("background/%1x%2")
+                .arg(size.width()).arg(size.height());
+        if (!selected(name))
+            continue;
+        ImageWindow w;
+        resizeWindow(w, size);
+        QImage frame(size, QImage::Format_ARGB32_Premultiplied);
+        QJsonObject params;
+        params["width"] = size.width();
+        params["height"] = size.height();
+        measure(name, params, [&]() {
+            QPainter p(&frame);
+            w.paintBackground(p);
+        });
+    }
+}
+
+void ImagingBenchmark::benchMultiply()
+{
+    LinearMultiply filter;
+    filter.setLight(QColor("#303030"));
+    for (QSize size : { QSize(1920, 1080), QSize(3840, 2160) }) {
+        for (bool simd : { false, true }) {
+            QString name = QString("multiply/%1x%2/%3")
+                    .arg(size.width()).arg(size.height())
+                    .arg(simd ? "simd" : "scalar");
+            if (!selected(name))
+                continue;
+            QImage frame = makeImage(size, QImage::Format_RGB32);
+            QJsonObject params;
+            params["width"] = size.width();
+            params["height"] = size.height();
+            params["megapixels"] = size.width() * size.height() / 1e6;
+            measure(name, params, [&]() {
+                filter.apply(frame, frame.rect(), simd);
+            });
+        }
+    }
+}
+
+void ImagingBenchmark::benchLoad(Source &src)
+{
+    QString name = "load/" + src.name;
+    if (!selected(name) || !prepare(src))
+        return;
+    QJsonObject params;
+    params["megapixels"] = src.megapixels;
+    params["format"] = QFileInfo(src.filename).suffix();
+    ImageWindow w;
+    measure(name, params, [&]() {
+        w.setSource(src.filename);
+    });
+}
+
+void ImagingBenchmark::benchDecode(Source &src)
+{
+    // Qt's plugins as the cropper used them before, against the fast decoders
+    // on one core and on all of them.
+    QString name = "decode/" + src.name;
+    if (!selected(name) || !prepare(src))
+        return;
+    QJsonObject params;
+    params["megapixels"] = src.megapixels;
+    params["format"] = QFileInfo(src.filename).suffix();
+    measure(name + "/qt", params, [&]() {
+        QImageReader(src.filename).read();
+    });
+    QImage image;
+    if (!ImageDecoder::readFast(src.filename, &image)) {
+        skip(name + "/fast", params, "no fast decoder for this format");
+        return;
+    }
+    int threads = QThread::idealThreadCount();
+    measure(name + "/fast", params, [&]() {
+        ImageDecoder::readFast(src.filename, &image);
+    });
+    params["threads"] = threads;
+    measure(name + "/fast-threads", params, [&]() {
+        ImageDecoder::readFast(src.filename, &image, threads);
+    });
+
+    // Qt writes no restart markers, which the JPEG decoder needs to split the
+    // work; cjpeg can put one at every row of MCUs.
+    if (QFileInfo(src.filename).suffix() != "jpg")
+        return;
+    QString cjpeg = QStandardPaths::findExecutable("cjpeg");
+    if (cjpeg.isEmpty()) {
+        skip(name + "/restart", params, "cjpeg not found");
+        return;
+    }
+    QString ppm = scratch.filePath("restart.ppm");
+    QString restart = scratch.filePath("restart.jpg");
+    QImageReader(src.filename).read().convertToFormat(QImage::Format_RGB32).save(ppm);
+    int status = QProcess::execute(cjpeg, { "-quality", "90", "-restart", "1",
+                                            "-outfile", restart, ppm });
+    QFile(ppm).remove();
+    if (status != 0) {
+        skip(name + "/restart", params, "cjpeg exited with an error");
+        return;
+    }
+    measure(name + "/restart/qt", params, [&]() {
+        QImageReader(restart).read();
+    });
+    measure(name + "/restart", params, [&]() {
+        ImageDecoder::readFast(restart, &image, threads);
+    });
+    QFile(restart).remove();
+}
+
+void ImagingBenchmark::benchPaint(Source &src)
+{
+    const QSize screen(1920, 1080);
+    ImageWindow w;
+    bool loaded = false;
+    qreal fit = screen.width() / (qreal)src.size.width();
+    struct { const char *label; qreal scaling; } scales[] = {
+        { "fit", fit }, { "1", 1.0 }, { "2", 2.0 }
+    };
+    for (auto scale : scales) {
+        for (qreal rotation : { 0.0, 15.0 }) {
+            QString name = QString("paint/%1/scale=%2/rotation=%3")
+                    .arg(src.name).arg(scale.label).arg(rotation);
+            if (!selected(name) || !prepare(src))
+                continue;
+            if (!loaded) {
+                w.setDisplayScale(1.0);
+                resizeWindow(w, screen);
+                w.setSource(src.filename);
+                loaded = true;
+            }
+            ImageCropping ic = w.getTransform();
+            ic.scaling = scale.scaling;
+            ic.rotation = rotation;
+            w.setTransform(ic);
+            QImage frame(screen, QImage::Format_ARGB32_Premultiplied);
+            QJsonObject params;
+            params["megapixels"] = src.megapixels;
+            params["scaling"] = scale.scaling;
+            params["rotation"] = rotation;
+            measure(name, params, [&]() {
+                w.render(&frame);
+            });
+            if (scale.scaling != fit || rotation != 0)
+                continue;
+            w.multiplying = true;
+            measure(name + "/multiply", params, [&]() {
+                w.render(&frame);
+            });
+            w.multiplying = false;
+        }
+    }
+}
+
+void ImagingBenchmark::benchExport(Source &src)
+{
+    QString name = "export/" + src.name;
+    if (!selected(name) || !prepare(src))
+        return;
+    QJsonObject params;
+    params["megapixels"] = src.megapixels;
+    QString convert = QStandardPaths::findExecutable("convert");
+    if (convert.isEmpty()) {
+        skip(name, params, "convert not found");
+        return;
+    }
+
+    // The fitted, slightly rotated framing takes the general resampler; the
+    // others take the planner's fast paths, two of them on a cropped read.
+    struct { const char *suffix; qreal scaling; qreal rotation; } framings[] = {
+        { "", 1920.0 / src.size.width(), 5 },
+        { "/resize", 1920.0 / src.size.width(), 0 },
+        { "/quarter", 1080.0 / src.size.width(), 90 },
+        { "/copy", 1, 0 },
+        { "/crop", 0.75, 5 }
+    };
+    for (auto framing : framings) {
+        ExportJob job;
+        job.sourceFilename = job.workingFilename = src.filename;
+        job.outputFilename = scratch.filePath("export.png");
+        job.transform = ImageCropping::fromSize(src.size);
+        job.transform.image = src.size;
+        job.transform.scaling = framing.scaling;
+        job.transform.rotation = framing.rotation;
+        job.size = QSize(1920, 1080);
+        job.light = "#303030";
+        QString entry = name + framing.suffix;
+        if (!selected(entry))
+            continue;
+        bool failed = false;
+        measure(entry, params, [&]() {
+            QProcess p;
+            p.start(convert, job.convertArguments());
+            p.waitForFinished(-1);
+            failed |= p.exitCode() != 0;
+        });
+        if (failed)
+            skip(entry + "/status", params, "convert exited with an error");
+    }
+}
+
+void ImagingBenchmark::checkExport()
+{
+    // Each planned export against the whole image through the general
+    // resampler, on a picture smooth enough that the two filters agree and
+    // any shift shows.  Odd and even sizes place their middles differently.
+    QString convert = QStandardPaths::findExecutable("convert");
+    QString compare = QStandardPaths::findExecutable("compare");
+    struct { const char *suffix; qreal scaling; qreal rotation; QPointF move; } framings[] = {
+        { "/fit", 1920.0 / 1000, 0, QPointF() },
+        { "/resize", 0.5, 0, QPointF(10, -6) },
+        { "/quarter", 1080.0 / 1000, 90, QPointF() },
+        { "/half", 1.5, 180, QPointF(-25, 17) },
+        { "/copy", 1, 0, QPointF(3, 4) },
+        { "/crop", 0.75, 5, QPointF(40, 0) }
+    };
+    for (QSize size : { QSize(1000, 666), QSize(1001, 667), QSize(1001, 666) }) {
+        QString name = QString("check/export/%1x%2")
+                .arg(size.width()).arg(size.height());
+        if (!selected(name))
+            continue;
+        if (convert.isEmpty() || compare.isEmpty()) {
+            skip(name, QJsonObject(), "convert or compare not found");
+            continue;
+        }
+        QImage image(size, QImage::Format_RGB32);
+        for (int y = 0; y < size.height(); y++) {
+            QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+            for (int x = 0; x < size.width(); x++)
+                line[x] = qRgb(int(128 + 100 * std::sin(x / 6.0)),
+                               int(128 + 100 * std::sin(y / 7.0)),
+                               int(128 + 100 * std::sin((x + y) / 9.0)));
+        }
+        QString source = scratch.filePath("check.png");
+        if (!image.save(source)) {
+            skip(name, QJsonObject(), "could not write the source");
+            continue;
+        }
+        for (auto framing : framings) {
+            QString entry = name + framing.suffix;
+            if (!selected(entry))
+                continue;
+            ExportJob job;
+            job.sourceFilename = job.workingFilename = source;
+            job.transform = ImageCropping::fromSize(size);
+            job.transform.image = size;
+            job.transform.scaling = framing.scaling;
+            job.transform.rotation = framing.rotation;
+            job.transform.translation += framing.move;
+            job.size = QSize(1920, 1080);
+            job.light = "#c0c0c0";
+            job.outputFilename = scratch.filePath("planned.png");
+            QStringList planned = job.convertArguments();
+            QString path = planned.contains("-distort") ? "distort"
+                    : planned.contains("-resize") ? "resize"
+                    : planned.contains("-rotate") ? "rotate" : "copy";
+            job.outputFilename = scratch.filePath("reference.png");
+            QStringList reference = job.convertArguments(false);
+            if (QProcess::execute(convert, planned) != 0
+                    || QProcess::execute(convert, reference) != 0) {
+                skip(entry, QJsonObject(), "convert exited with an error");
+                continue;
+            }
+            // compare reports the normalised error in brackets on stderr.
+            QProcess p;
+            p.start(compare, { "-metric", "RMSE", scratch.filePath("planned.png"),
+                               scratch.filePath("reference.png"), "null:" });
+            p.waitForFinished(-1);
+            QString report = QString::fromLocal8Bit(p.readAllStandardError());
+            int open = report.indexOf('(');
+            bool ok = false;
+            double rmse = report.mid(open + 1, report.indexOf(')') - open - 1).toDouble(&ok);
+            if (open < 0 || !ok) {
+                skip(entry, QJsonObject(), "compare failed: " + report.trimmed());
+                continue;
+            }
+            QJsonObject params;
+            params["width"] = size.width();
+            params["height"] = size.height();
+            params["path"] = path;
+            QJsonObject result;
+            result["name"] = entry;
+            result["params"] = params;
+            result["rmse"] = rmse;
+            result["matches"] = rmse <= checkTolerance;
+            entries.append(result);
+            err() << entry << ": " << path << ", rmse " << rmse
+                  << (rmse <= checkTolerance ? "" : " MISMATCH") << endl;
+        }
+        QFile(source).remove();
+    }
+}
+
+QList<ImagingBenchmark::Source> ImagingBenchmark::sources()
+{
+    QList<Source> list;
+    struct { const char *name; QImage::Format format; } formats[] = {
+        { "RGB32", QImage::Format_RGB32 },
+        { "ARGB32", QImage::Format_ARGB32 },
+        { "Grayscale8", QImage::Format_Grayscale8 }
+    };
+    for (int mp : { 1, 12, 50, 200 }) {
+        for (auto format : formats) {
+            Source s;
+            s.name = QString("%1MP/%2").arg(mp).arg(format.name);
+            s.format = format.format;
+            s.megapixels = mp;
+            int w = std::lround(std::sqrt(mp * 1e6 * 3 / 2));
+            s.size = QSize(w, std::lround(w * 2 / 3.0));
+            list << s;
+        }
+    }
+    return list;
+}
+
+QImage ImagingBenchmark::makeImage(QSize size, QImage::Format format)
+{
+    QImage img(size, format);
+    quint32 state = 0x9e3779b9;
+    for (int y = 0; y < img.height(); y++) {
+        uchar *line = img.scanLine(y);
+        for (int x = 0; x < img.width(); x++) {
+            // Gradients plus a little noise, so that codecs have to work.
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int noise = state & 15;
+            int r = (x * 255 / img.width() + noise) & 0xff;
+            int g = (y * 255 / img.height() + noise) & 0xff;
+            int b = ((x ^ y) + noise) & 0xff;
+            if (format == QImage::Format_Grayscale8) {
+                line[x] = (r + g + b) / 3;
+            } else {
+                int a = format == QImage::Format_ARGB32 ? (x + y) & 0xff : 0xff;
+                reinterpret_cast<QRgb*>(line)[x] = qRgba(r, g, b, a);
+            }
+        }
+    }
+    return img;
+}
+
+bool ImagingBenchmark::prepare(Source &src)
+{
+    if (!src.filename.isEmpty())
+        return true;
+    err() << "preparing " << src.name << endl;
+    QString suffix = src.format == QImage::Format_ARGB32 ? "png" : "jpg";
+    QString filename = scratch.filePath(QString("source.%1").arg(suffix));
+    QImageWriter writer(filename);
+    writer.setQuality(90);
+    if (!writer.write(makeImage(src.size, src.format))) {
+        skip("prepare/" + src.name, QJsonObject(), writer.errorString());
+        return false;
+    }
+    src.filename = filename;
+    return true;
+}
+
+bool ImagingBenchmark::selected(const QString &name)
+{
+    return filter.pattern().isEmpty() || filter.match(name).hasMatch();
+}
+
+void ImagingBenchmark::measure(const QString &name, const QJsonObject &params,
+                               std::function<void()> body, int batch)
+{
+    QVector<double> samples;
+    QElapsedTimer total;
+    total.start();
+    while (samples.isEmpty()
+           || (total.elapsed() < minimumTime && samples.size() < 1000)) {
+        QElapsedTimer t;
+        t.start();
+        body();
+        samples << t.nsecsElapsed() / (double)batch;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    double mean = sum / samples.size();
+    double variance = 0;
+    for (double s : samples)
+        variance += (s - mean) * (s - mean);
+
+    QJsonObject entry;
+    entry["name"] = name;
+    entry["params"] = params;
+    entry["iterations"] = samples.size() * batch;
+    entry["min_ns"] = samples.first();
+    entry["median_ns"] = samples.at(samples.size() / 2);
+    entry["mean_ns"] = mean;
+    entry["max_ns"] = samples.last();
+    entry["stddev_ns"] = std::sqrt(variance / samples.size());
+    if (params.contains("megapixels"))
+        entry["megapixels_per_second"] =
+                params["megapixels"].toDouble() * 1e9 / samples.at(samples.size() / 2);
+    entries.append(entry);
+
+    err() << name << ": " << samples.at(samples.size() / 2) / 1e6
+          << " ms median over " << samples.size() << " runs" << endl;
+}
+
+void ImagingBenchmark::skip(const QString &name, const QJsonObject &params,
+                            const QString &reason)
+{
+    QJsonObject entry;
+    entry["name"] = name;
+    entry["params"] = params;
+    entry["skipped"] = reason;
+    entries.append(entry);
+    err() << name << ": skipped (" << reason << ")" << endl;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName("Dark Cropper Benchmarks");
+    QCoreApplication::setOrganizationName("cmdrkotori");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks for the imaging hot paths.");
+    parser.addHelpOption();
+    QCommandLineOption outputOption({"o", "output"},
+            "Write JSON results to <file> (- for stdout).", "file", "-");
+    QCommandLineOption filterOption({"f", "filter"},
+            "Only run benchmarks whose name matches <regex>.", "regex");
+    QCommandLineOption maxOption("max-megapixels",
+            "Skip synthetic sources larger than <mp>.", "mp", "200");
+    QCommandLineOption timeOption("min-time",
+            "Repeat each benchmark for at least <msec>.", "msec", "1000");
+    parser.addOptions({ outputOption, filterOption, maxOption, timeOption });
+    parser.process(a);
+
+    ImagingBenchmark bench;
+    bench.setFilter(parser.value(filterOption));
+    bench.setMaxMegapixels(parser.value(maxOption).toInt());
+    bench.setMinimumTime(parser.value(timeOption).toInt());
+    bench.run();
+
+    QByteArray json = QJsonDocument(bench.results()).toJson();
+    QString output = parser.value(outputOption);
+    QFile f(output);
+    bool opened = output == "-" ? f.open(stdout, QFile::WriteOnly)
+                                : f.open(QFile::WriteOnly | QFile::Truncate);
+    if (!opened) {
+        err() << "could not write " << output << endl;
+        return 1;
+    }
+    f.write(json);
+    return 0;
+}
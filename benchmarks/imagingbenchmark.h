@@ -0,0 +1,59 @@
+#ifndef IMAGINGBENCHMARK_H
+#define IMAGINGBENCHMARK_H
+
+#include <functional>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+
+// Runs each hot path against synthetic sources and collects the timings as
+// JSON, so that results from different builds and machines can be diffed.
+class ImagingBenchmark {
+public:
+    ImagingBenchmark();
+
+    void setFilter(const QString &pattern);
+    void setMaxMegapixels(int mp);
+    void setMinimumTime(int msec);
+
+    void run();
+    QJsonObject results();
+
+private:
+    struct Source {
+        QString name;
+        QImage::Format format;
+        int megapixels;
+        QSize size;
+        QString filename;
+    };
+
+    void benchTransform();
+    void benchBackground();
+    void benchMultiply();
+    void benchLoad(Source &src);
+    void benchDecode(Source &src);
+    void benchPaint(Source &src);
+    void benchExport(Source &src);
+    void checkExport();
+
+    QList<Source> sources();
+    QImage makeImage(QSize size, QImage::Format format);
+    bool prepare(Source &src);
+
+    bool selected(const QString &name);
+    void measure(const QString &name, const QJsonObject &params,
+                 std::function<void()> body, int batch = 1);
+    void skip(const QString &name, const QJsonObject &params,
+              const QString &reason);
+
+    QRegularExpression filter;
+    int maxMegapixels;
+    int minimumTime;
+    QTemporaryDir scratch;
+    QJsonArray entries;
+};
+
+#endif // IMAGINGBENCHMARK_H
@@ -0,0 +1,135 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include "controlserver.h"
+#include "mainwindow.h"
+
+// Requests longer than this without a newline are not from a well-behaved
+// client; drop the connection rather than buffer without bound.
+static const qint64 maxLineLength = 64 << 20;
+
+ControlServer::ControlServer(MainWindow *mainWindow, QObject *parent)
+    : QObject(parent), mainWindow(mainWindow)
+{
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    connect(&server, &QLocalServer::newConnection,
+            this, &ControlServer::server_newConnection);
+
+    connect(mainWindow, &MainWindow::fileQueued, this, [this](QString file) {
+        broadcast({{"event", "queued"}, {"file", file}});
+    });
+    connect(mainWindow, &MainWindow::fileSkipped, this, [this](QString file) {
+        broadcast({{"event", "skipped"}, {"file", file}});
+    });
+    connect(mainWindow, &MainWindow::fileExported,
+            this, [this](QString source, QString output, bool ok, qint64 msecs) {
+        broadcast({{"event", "exported"}, {"file", source}, {"output", output},
+                   {"ok", ok}, {"ms", double(msecs)}});
+    });
+    connect(mainWindow, &MainWindow::fileDoubled,
+            this, [this](QString source, bool ok) {
+        broadcast({{"event", "doubled"}, {"file", source}, {"ok", ok}});
+    });
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    if (server.listen(name))
+        return true;
+    // A stale socket from a crashed run is taken over; a live one is not.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(200))
+        return false;
+    QLocalServer::removeServer(name);
+    return server.listen(name);
+}
+
+QString ControlServer::serverName() const
+{
+    return server.fullServerName();
+}
+
+void ControlServer::server_newConnection()
+{
+    while (QLocalSocket *socket = server.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead,
+                this, &ControlServer::socket_readyRead);
+        connect(socket, &QLocalSocket::disconnected,
+                this, &ControlServer::socket_disconnected);
+    }
+}
+
+void ControlServer::socket_readyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+        QJsonObject reply;
+        if (!doc.isObject()) {
+            reply = {{"ok", false}, {"error", error.error != QJsonParseError::NoError
+                                              ? error.errorString()
+                                              : QString("expected an object")}};
+        } else {
+            reply = handle(socket, doc.object());
+            if (doc.object().contains("id"))
+                reply["id"] = doc.object()["id"];
+        }
+        send(socket, reply);
+    }
+    if (socket->bytesAvailable() > maxLineLength)
+        socket->abort();
+}
+
+void ControlServer::socket_disconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    subscribers.remove(socket);
+    socket->deleteLater();
+}
+
+QJsonObject ControlServer::handle(QLocalSocket *socket, const QJsonObject &request)
+{
+    QString cmd = request["cmd"].toString();
+    if (cmd == "ping")
+        return {{"ok", true}};
+    if (cmd == "enqueue") {
+        QStringList files;
+        for (const QJsonValue &v : request["paths"].toArray())
+            if (v.isString())
+                files << v.toString();
+        return {{"ok", true}, {"added", mainWindow->enqueue(files)}};
+    }
+    if (cmd == "status")
+        return {{"ok", true}, {"status", mainWindow->status()}};
+    if (cmd == "queue") {
+        QStringList files = mainWindow->queue(request["offset"].toInt(0),
+                                              request["limit"].toInt(100));
+        return {{"ok", true}, {"files", QJsonArray::fromStringList(files)}};
+    }
+    if (cmd == "subscribe") {
+        subscribers.insert(socket);
+        return {{"ok", true}};
+    }
+    if (cmd == "unsubscribe") {
+        subscribers.remove(socket);
+        return {{"ok", true}};
+    }
+    return {{"ok", false}, {"error", "unknown command: " + cmd}};
+}
+
+void ControlServer::broadcast(const QJsonObject &event)
+{
+    for (QLocalSocket *socket : subscribers)
+        send(socket, event);
+}
+
+void ControlServer::send(QLocalSocket *socket, const QJsonObject &message)
+{
+    socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact));
+    socket->write("\n");
+}
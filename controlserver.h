@@ -0,0 +1,40 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QSet>
+
+class QLocalSocket;
+class MainWindow;
+
+// Line-delimited JSON control endpoint on a local socket.  Each request is one
+// JSON object with a "cmd" and an optional "id" that is echoed back:
+//   {"cmd":"enqueue","paths":[...]}      -> {"ok":true,"added":N}
+//   {"cmd":"status"}                     -> {"ok":true,"status":{...}}
+//   {"cmd":"queue","offset":0,"limit":N} -> {"ok":true,"files":[...]}
+//   {"cmd":"subscribe"} / {"cmd":"unsubscribe"}
+// Subscribed clients also receive {"event":...} lines as work completes.
+class ControlServer : public QObject {
+    Q_OBJECT
+public:
+    ControlServer(MainWindow *mainWindow, QObject *parent = 0);
+    bool listen(const QString &name);
+    QString serverName() const;
+
+private slots:
+    void server_newConnection();
+    void socket_readyRead();
+    void socket_disconnected();
+
+private:
+    QJsonObject handle(QLocalSocket *socket, const QJsonObject &request);
+    void broadcast(const QJsonObject &event);
+    static void send(QLocalSocket *socket, const QJsonObject &message);
+
+    QLocalServer server;
+    MainWindow *mainWindow;
+    QSet<QLocalSocket*> subscribers;
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,19 @@
+# Sources that need nothing beyond QtCore, shared with the export worker.
+
+CONFIG += C++11
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/imagecropping.cpp \
+    $$PWD/exportjob.cpp \
+    $$PWD/exportspool.cpp \
+    $$PWD/heartbeatmonitor.cpp \
+    $$PWD/jsonfile.cpp \
+    $$PWD/exportindex.cpp
+
+HEADERS += $$PWD/imagecropping.h \
+    $$PWD/exportjob.h \
+    $$PWD/exportspool.h \
+    $$PWD/heartbeatmonitor.h \
+    $$PWD/jsonfile.h \
+    $$PWD/exportindex.h
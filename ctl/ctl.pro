@@ -0,0 +1,11 @@
+# Command-line client for the control socket of a running darkcropper.
+#   ./darkcropper-ctl enqueue ~/inbox/*.png
+#   ./darkcropper-ctl status
+
+TARGET = darkcropper-ctl
+TEMPLATE = app
+QT = core network
+CONFIG += console C++11
+CONFIG -= app_bundle
+
+SOURCES += darkcropperctl.cpp
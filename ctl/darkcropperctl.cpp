@@ -0,0 +1,130 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QTextStream>
+
+// Paths are sent in chunks so that a huge list from stdin neither has to be
+// held in one request nor stalls the GUI while it is parsed.
+static const int enqueueChunk = 1000;
+
+static QTextStream out(stdout);
+static QTextStream err(stderr);
+
+static bool request(QLocalSocket &socket, const QJsonObject &message,
+                    QJsonObject *reply)
+{
+    socket.write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+    if (!socket.waitForBytesWritten(5000))
+        return false;
+    while (!socket.canReadLine())
+        if (!socket.waitForReadyRead(30000))
+            return false;
+    *reply = QJsonDocument::fromJson(socket.readLine()).object();
+    return true;
+}
+
+static int enqueue(QLocalSocket &socket, QStringList paths)
+{
+    if (paths.isEmpty() || paths == QStringList("-")) {
+        paths.clear();
+        QTextStream in(stdin);
+        QString line;
+        while (in.readLineInto(&line))
+            if (!line.isEmpty())
+                paths << line;
+    }
+    int added = 0;
+    for (int i = 0; i < paths.count(); i += enqueueChunk) {
+        QJsonArray chunk;
+        for (const QString &path : paths.mid(i, enqueueChunk))
+            chunk << QFileInfo(path).absoluteFilePath();
+        QJsonObject reply;
+        if (!request(socket, {{"cmd", "enqueue"}, {"paths", chunk}}, &reply)
+                || !reply["ok"].toBool()) {
+            err << "enqueue failed: " << reply["error"].toString() << endl;
+            return 1;
+        }
+        added += reply["added"].toInt();
+    }
+    out << added << " of " << paths.count() << " files queued" << endl;
+    return 0;
+}
+
+static int watch(QLocalSocket &socket)
+{
+    QJsonObject reply;
+    if (!request(socket, {{"cmd", "subscribe"}}, &reply) || !reply["ok"].toBool())
+        return 1;
+    while (socket.state() == QLocalSocket::ConnectedState) {
+        while (socket.canReadLine())
+            out << socket.readLine().trimmed() << endl;
+        socket.waitForReadyRead(-1);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("darkcropper-ctl");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+            "Talks to a running darkcropper.\n\n"
+            "Commands:\n"
+            "  enqueue [file...|-]   queue files (from stdin when none or -)\n"
+            "  status                print queue, job and memory state as JSON\n"
+            "  queue                 list queued files\n"
+            "  watch                 print completion events as they happen\n"
+            "  send <json>           send a raw request and print the reply");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "One of the commands above.");
+    QCommandLineOption serverOption({"s", "server"},
+            "Local socket name of the instance.", "name", "darkcropper");
+    QCommandLineOption limitOption("limit",
+            "Number of files to list with queue.", "n", "100");
+    parser.addOptions({ serverOption, limitOption });
+    parser.process(a);
+
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty())
+        parser.showHelp(1);
+    QString command = args.takeFirst();
+
+    QLocalSocket socket;
+    socket.connectToServer(parser.value(serverOption));
+    if (!socket.waitForConnected(2000)) {
+        err << "could not connect to " << parser.value(serverOption) << ": "
+            << socket.errorString() << endl;
+        return 1;
+    }
+
+    if (command == "enqueue")
+        return enqueue(socket, args);
+    if (command == "watch")
+        return watch(socket);
+
+    QJsonObject message;
+    if (command == "status") {
+        message["cmd"] = "status";
+    } else if (command == "queue") {
+        message["cmd"] = "queue";
+        message["limit"] = parser.value(limitOption).toInt();
+    } else if (command == "send" && args.count() == 1) {
+        message = QJsonDocument::fromJson(args.first().toUtf8()).object();
+    } else {
+        parser.showHelp(1);
+    }
+
+    QJsonObject reply;
+    if (!request(socket, message, &reply)) {
+        err << "no reply: " << socket.errorString() << endl;
+        return 1;
+    }
+    out << QJsonDocument(reply).toJson(QJsonDocument::Indented);
+    return reply["ok"].toBool() ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+# Sources shared between the application and the auxiliary targets.
+
+QT       += core gui widgets opengl
+
+include($$PWD/core.pri)
+
+SOURCES += $$PWD/mainwindow.cpp \
+    $$PWD/imagewindow.cpp \
+    $$PWD/exportqueue.cpp \
+    $$PWD/magickpool.cpp \
+    $$PWD/sessionrecorder.cpp \
+    $$PWD/linearmultiply.cpp \
+    $$PWD/framescheduler.cpp \
+    $$PWD/tiledimage.cpp \
+    $$PWD/memorybudget.cpp \
+    $$PWD/folderwatcher.cpp \
+    $$PWD/imageprefetcher.cpp \
+    $$PWD/scratchmanager.cpp \
+    $$PWD/imageindex.cpp \
+    $$PWD/thumbnailcache.cpp \
+    $$PWD/filmstrip.cpp \
+    $$PWD/groupreview.cpp \
+    $$PWD/processorcalibration.cpp \
+    $$PWD/processgovernor.cpp \
+    $$PWD/imagedecoder.cpp \
+    $$PWD/deferredexport.cpp \
+    $$PWD/sharedqueue.cpp \
+    $$PWD/stallwatchdog.cpp \
+    $$PWD/spoolmonitor.cpp
+
+HEADERS  += $$PWD/mainwindow.h \
+    $$PWD/imagewindow.h \
+    $$PWD/exportqueue.h \
+    $$PWD/magickpool.h \
+    $$PWD/sessionrecorder.h \
+    $$PWD/linearmultiply.h \
+    $$PWD/framescheduler.h \
+    $$PWD/tiledimage.h \
+    $$PWD/memorybudget.h \
+    $$PWD/folderwatcher.h \
+    $$PWD/imageprefetcher.h \
+    $$PWD/scratchmanager.h \
+    $$PWD/imageindex.h \
+    $$PWD/thumbnailcache.h \
+    $$PWD/filmstrip.h \
+    $$PWD/groupreview.h \
+    $$PWD/processorcalibration.h \
+    $$PWD/processgovernor.h \
+    $$PWD/imagedecoder.h \
+    $$PWD/deferredexport.h \
+    $$PWD/sharedqueue.h \
+    $$PWD/stallwatchdog.h \
+    $$PWD/spoolmonitor.h
+
+# Faster decoders for the common source formats, each used when found.
+packagesExist(libturbojpeg) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libturbojpeg
+    DEFINES += HAVE_TURBOJPEG
+}
+packagesExist(spng) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += spng
+    DEFINES += HAVE_SPNG
+}
+packagesExist(libwebp) {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += libwebp
+    DEFINES += HAVE_WEBP
+}
+
+FORMS    += $$PWD/mainwindow.ui
+
+RESOURCES += \
+    $$PWD/resources.qrc
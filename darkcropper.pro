@@ -1,28 +1,20 @@
-#-------------------------------------------------
-#
-# Project created by QtCreator 2016-05-19T22:59:57
-#
-#-------------------------------------------------
+TEMPLATE = subdirs
 
-QT       += core gui widgets opengl
+SUBDIRS += \
+    app \
+    benchmarks \
+    replay \
+    ctl \
+    worker
 
-TARGET = darkcropper
-TEMPLATE = app
-CONFIG += C++11
+app.file = app.pro
+benchmarks.subdir = benchmarks
+replay.subdir = replay
+ctl.subdir = ctl
+worker.subdir = worker
 
-SOURCES += main.cpp\
-        mainwindow.cpp \
-    imagewindow.cpp
-
-HEADERS  += mainwindow.h \
-    imagewindow.h
-
-FORMS    += mainwindow.ui
-
-DISTFILES += \
-    .gitignore \
-    LICENSE \
-    README.md
-
-RESOURCES += \
-    resources.qrc
+# The in-process ImageMagick helper is optional; exports fall back to convert.
+packagesExist(MagickWand) {
+    SUBDIRS += magick
+    magick.subdir = magick
+}
@@ -0,0 +1,145 @@
+#include <QFileInfo>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QTransform>
+#include "deferredexport.h"
+#include "processgovernor.h"
+#include "scratchmanager.h"
+
+DeferredExport::DeferredExport(QProcess *doubler, const Doubling &doubling,
+                               QObject *parent)
+    : QObject(parent), doubler(doubler), d(doubling)
+{
+    doubler->setParent(this);
+    watch();
+}
+
+DeferredExport::~DeferredExport()
+{
+    // Only reached early when the application quits; the process goes with
+    // this object, and so do the files it was working on.
+    if (doubler) {
+        doubler->disconnect(this);
+        doubler->kill();
+        doubler->waitForFinished();
+        ScratchManager *scratch = ScratchManager::instance();
+        scratch->release(d.outputFilename);
+        if (!d.croppedFilename.isEmpty())
+            scratch->release(d.croppedFilename);
+        if (d.inputFilename != d.sourceFilename)
+            scratch->release(d.inputFilename);
+    }
+}
+
+QString DeferredExport::sourceFilename() const
+{
+    return d.sourceFilename;
+}
+
+void DeferredExport::process_finished(int exitCode)
+{
+    QString program = doubler->program();
+    QStringList arguments = doubler->arguments();
+    QString error = QString::fromUtf8(doubler->readAllStandardError()).trimmed();
+    doubler->deleteLater();
+    doubler = NULL;
+
+    ScratchManager *scratch = ScratchManager::instance();
+    if (!d.croppedFilename.isEmpty())
+        scratch->release(d.croppedFilename);
+    d.croppedFilename.clear();
+    if (exitCode) {
+        // Nobody is waiting at the cropper to be told; the framing is still
+        // good on the copy as it was.
+        qWarning("doubling %s failed: %s", qPrintable(d.sourceFilename),
+                 qPrintable(error));
+        scratch->release(d.outputFilename);
+        emit doubled(d.sourceFilename, false);
+        emit ready(d.sourceFilename, d.inputFilename, d.framing, d.provenance);
+        deleteLater();
+        return;
+    }
+
+    if (d.region.isValid() && !regionCovers()) {
+        // The operator moved the framing past the region while waifu2x ran;
+        // rather than pad the export or lose part of it, all of the input is
+        // doubled after all.
+        scratch->release(d.outputFilename);
+        d.region = QRect();
+        d.doublingProvenance.remove(QRegularExpression(" region=[^;]*"));
+        start(program, arguments);
+        return;
+    }
+
+    // As in ImageWindow::process_finished(): a region moves the translation by
+    // its offset from the centre, t' = t + R(s d), and the scaling halves.
+    if (d.inputFilename != d.sourceFilename)
+        scratch->release(d.inputFilename);
+    scratch->update(d.outputFilename);
+    QSize doubledSize = (d.region.isValid() ? d.region.size() : d.inputSize) * 2;
+    if (d.region.isValid()) {
+        QPointF offset = QRectF(d.region).center()
+                - QPointF(d.inputSize.width() / 2.0, d.inputSize.height() / 2.0);
+        d.framing.translation += QTransform().rotate(d.framing.rotation)
+                .map(offset * d.framing.scaling);
+    }
+    d.framing.sourceScaledBy(1);
+    d.framing.image = doubledSize;
+    d.provenance += d.doublingProvenance;
+    d.inputFilename = d.outputFilename;
+    d.inputSize = doubledSize;
+    d.region = QRect();
+    emit doubled(d.sourceFilename, true);
+
+    if (d.repeats > 0) {
+        d.repeats--;
+        start(program, arguments);
+        return;
+    }
+    emit ready(d.sourceFilename, d.inputFilename, d.framing, d.provenance);
+    deleteLater();
+}
+
+void DeferredExport::start(const QString &program, QStringList arguments)
+{
+    // The same waifu2x invocation again, on what the last one produced.
+    d.outputFilename = ScratchManager::instance()->allocate(
+                QFileInfo(d.inputFilename).suffix(),
+                QFileInfo(d.inputFilename).size() * 4);
+    int input = arguments.indexOf("-i");
+    int output = arguments.indexOf("-o");
+    if (input >= 0 && input + 1 < arguments.count())
+        arguments[input + 1] = d.inputFilename;
+    if (output >= 0 && output + 1 < arguments.count())
+        arguments[output + 1] = d.outputFilename;
+    doubler = ProcessGovernor::instance()->create(this);
+    doubler->setProgram(program);
+    doubler->setArguments(arguments);
+    watch();
+    doubler->start();
+}
+
+void DeferredExport::watch()
+{
+    // A process that never starts never finishes either; it fails the same
+    // way as one that exits with an error.
+    connect(doubler, SIGNAL(finished(int)),
+            this, SLOT(process_finished(int)));
+    connect(doubler, &QProcess::errorOccurred, this, [this](QProcess::ProcessError e) {
+        if (e == QProcess::FailedToStart)
+            process_finished(-1);
+    });
+}
+
+bool DeferredExport::regionCovers()
+{
+    // As ImageWindow::regionCovers(), for the framing the export was made with.
+    QSizeF frame = d.frame;
+    QRectF needed = d.framing.transform().inverted()
+            .mapRect(QRectF(QPointF(-frame.width() / 2, -frame.height() / 2), frame))
+            .translated(d.inputSize.width() / 2.0, d.inputSize.height() / 2.0)
+            & QRectF(QPointF(0, 0), QSizeF(d.inputSize));
+    if (needed.isEmpty())
+        return true;
+    return QRectF(d.region).adjusted(-0.5, -0.5, 0.5, 0.5).contains(needed);
+}
@@ -0,0 +1,54 @@
+#ifndef DEFERREDEXPORT_H
+#define DEFERREDEXPORT_H
+
+#include <QObject>
+#include <QRect>
+#include "imagewindow.h"
+
+class QProcess;
+
+// An export waiting on a doubling that was still running when it was asked
+// for.  It takes the waifu2x process over from the cropper, which moves on to
+// the next file, and once the doubled copy lands it fits the framing to it as
+// the cropper would have and hands the export on.  Any number of these may be
+// in flight at once.
+class DeferredExport : public QObject {
+    Q_OBJECT
+public:
+    struct Doubling {
+        QString sourceFilename;
+        QString inputFilename;      // the working copy being doubled
+        QSize inputSize;
+        QString croppedFilename;    // the region cut from it for waifu2x, if any
+        QRect region;
+        QString outputFilename;
+        int repeats;                // whole-image doublings still to follow
+        QString provenance;         // of the input
+        QString doublingProvenance;
+        ImageCropping framing;      // on the input
+        QSize frame;                // what the framing shows, in output pixels
+    };
+
+    DeferredExport(QProcess *doubler, const Doubling &doubling,
+                   QObject *parent = 0);
+    ~DeferredExport();
+    QString sourceFilename() const;
+
+signals:
+    void doubled(QString sourceFilename, bool ok);
+    void ready(QString sourceFilename, QString workingFilename,
+               ImageCropping transform, QString provenance);
+
+private slots:
+    void process_finished(int exitCode);
+
+private:
+    void start(const QString &program, QStringList arguments);
+    void watch();
+    bool regionCovers();
+
+    QProcess *doubler;
+    Doubling d;
+};
+
+#endif // DEFERREDEXPORT_H
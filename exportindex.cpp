@@ -0,0 +1,147 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "exportindex.h"
+
+ExportIndex *ExportIndex::forFolder(const QString &folder)
+{
+    static QHash<QString, ExportIndex*> indexes;
+    QString key = QDir(folder).absolutePath();
+    ExportIndex *&index = indexes[key];
+    if (!index)
+        index = new ExportIndex(key);
+    return index;
+}
+
+ExportIndex::ExportIndex(const QString &folder)
+    : filename(folder + "/.darkcropper-exports.jsonl"), offset(0)
+{
+}
+
+bool ExportIndex::lookup(const QString &outputFilename, Entry *entry)
+{
+    refresh();
+    auto it = entries.constFind(QFileInfo(outputFilename).fileName());
+    if (it == entries.constEnd())
+        return false;
+    *entry = *it;
+    return true;
+}
+
+QByteArray ExportIndex::cachedSourceHash(const QString &sourceFilename,
+                                         const QString &outputFilename)
+{
+    // Hashing a large source costs far more than a stat, so the last hash is
+    // reused for as long as the file looks the same.
+    Entry e;
+    if (lookup(outputFilename, &e) && sourceUnchanged(e, sourceFilename))
+        return e.sourceHash;
+    return QByteArray();
+}
+
+bool ExportIndex::isUnchanged(const ExportJob &job)
+{
+    Entry e;
+    return lookup(job.outputFilename, &e)
+            && QFileInfo(job.outputFilename).exists()
+            && e.fingerprint == job.fingerprint();
+}
+
+bool ExportIndex::isExported(const QString &sourceFilename,
+                             const QString &outputFilename,
+                             const QSize &size, const QString &light)
+{
+    // Without the framing, which is only known once cropped, the best that can
+    // be said is that this source went out at this size and light.
+    Entry e;
+    return lookup(outputFilename, &e)
+            && QFileInfo(outputFilename).exists()
+            && sourceUnchanged(e, sourceFilename)
+            && e.size == size && e.light == light;
+}
+
+void ExportIndex::record(const ExportJob &job)
+{
+    QFileInfo source(job.sourceFilename);
+    QJsonObject r;
+    r["output"] = QFileInfo(job.outputFilename).fileName();
+    r["source"] = source.absoluteFilePath();
+    r["source_size"] = double(source.size());
+    r["source_mtime"] = double(source.lastModified().toMSecsSinceEpoch());
+    r["source_hash"] = QString::fromLatin1(job.sourceHash.toHex());
+    r["provenance"] = job.provenance;
+    r["fingerprint"] = QString::fromLatin1(job.fingerprint().toHex());
+    r["width"] = job.size.width();
+    r["height"] = job.size.height();
+    r["light"] = job.light;
+
+    refresh();
+    QFile f(filename);
+    if (!f.open(QFile::WriteOnly | QFile::Append))
+        return;
+    // One write per record keeps concurrent appends from interleaving.
+    f.write(QJsonDocument(r).toJson(QJsonDocument::Compact) + "\n");
+
+    Entry e;
+    e.source = r["source"].toString();
+    e.sourceSize = source.size();
+    e.sourceModified = source.lastModified();
+    e.sourceHash = job.sourceHash;
+    e.fingerprint = job.fingerprint();
+    e.size = job.size;
+    e.light = job.light;
+    entries.insert(r["output"].toString(), e);
+}
+
+QByteArray ExportIndex::hashFile(const QString &filename)
+{
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly))
+        return QByteArray();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&f);
+    return hash.result();
+}
+
+void ExportIndex::refresh()
+{
+    // Pick up whatever other processes have appended since the last read.
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly))
+        return;
+    if (f.size() < offset) {
+        entries.clear();
+        offset = 0;
+    }
+    if (f.size() == offset || !f.seek(offset))
+        return;
+    while (!f.atEnd()) {
+        QByteArray line = f.readLine();
+        if (!line.endsWith('\n'))
+            break;  // a record still being written
+        offset = f.pos();
+        QJsonObject r = QJsonDocument::fromJson(line).object();
+        if (r.isEmpty())
+            continue;
+        Entry e;
+        e.source = r["source"].toString();
+        e.sourceSize = r["source_size"].toDouble();
+        e.sourceModified = QDateTime::fromMSecsSinceEpoch(r["source_mtime"].toDouble());
+        e.sourceHash = QByteArray::fromHex(r["source_hash"].toString().toLatin1());
+        e.fingerprint = QByteArray::fromHex(r["fingerprint"].toString().toLatin1());
+        e.size = QSize(r["width"].toInt(), r["height"].toInt());
+        e.light = r["light"].toString();
+        entries.insert(r["output"].toString(), e);
+    }
+}
+
+bool ExportIndex::sourceUnchanged(const Entry &entry, const QString &sourceFilename)
+{
+    QFileInfo info(sourceFilename);
+    return entry.source == info.absoluteFilePath()
+            && entry.sourceSize == info.size()
+            && entry.sourceModified == info.lastModified();
+}
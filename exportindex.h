@@ -0,0 +1,50 @@
+#ifndef EXPORTINDEX_H
+#define EXPORTINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QSize>
+#include <QString>
+#include "exportjob.h"
+
+// What was last exported into a folder and from what, kept beside the outputs
+// in .darkcropper-exports.jsonl.  Records are only ever appended, one JSON
+// object per line, so that the GUI and spool workers can share the file; the
+// last record for an output wins.
+class ExportIndex {
+public:
+    struct Entry {
+        QString source;
+        qint64 sourceSize;
+        QDateTime sourceModified;
+        QByteArray sourceHash;
+        QByteArray fingerprint;
+        QSize size;
+        QString light;
+
+        Entry() : sourceSize(0) {}
+    };
+
+    static ExportIndex *forFolder(const QString &folder);
+
+    bool lookup(const QString &outputFilename, Entry *entry);
+    QByteArray cachedSourceHash(const QString &sourceFilename,
+                                const QString &outputFilename);
+    bool isUnchanged(const ExportJob &job);
+    bool isExported(const QString &sourceFilename, const QString &outputFilename,
+                    const QSize &size, const QString &light);
+    void record(const ExportJob &job);
+
+    static QByteArray hashFile(const QString &filename);
+
+private:
+    ExportIndex(const QString &folder);
+    void refresh();
+    bool sourceUnchanged(const Entry &entry, const QString &sourceFilename);
+
+    QString filename;
+    qint64 offset;
+    QHash<QString, Entry> entries;
+};
+
+#endif // EXPORTINDEX_H
@@ -0,0 +1,360 @@
+#include <cmath>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QRectF>
+#include <QtEndian>
+#include <QtMath>
+#include "exportjob.h"
+
+static QString sizeToString(const QSize &sz)
+{
+    return QString("%1x%2")
+            .arg(sz.width())
+            .arg(sz.height());
+}
+
+static QString placeToString(const QPointF &sz)
+{
+    return QString("%1%2%3%4")
+            .arg(sz.x() < 0 ? "" : "+").arg(sz.x(), 0, 'f', 5)
+            .arg(sz.y() < 0 ? "" : "+").arg(sz.y(), 0, 'f', 5);
+}
+
+static QString offsetToString(const QPoint &p)
+{
+    return QString("%1%2%3%4")
+            .arg(p.x() < 0 ? "" : "+").arg(p.x())
+            .arg(p.y() < 0 ? "" : "+").arg(p.y());
+}
+
+static bool nearly(qreal a, qreal b)
+{
+    return std::abs(a - b) < 1e-6;
+}
+
+// How far the fast paths may put a region's edge from where the framing does,
+// in output pixels, and how many pixels a region may grow to find such a place.
+static const qreal alignTolerance = 0.02;
+static const int alignGrowth = 64;
+
+// Where the framing puts each point of the image in the output, as the
+// preview does: the middle of the image, translated, at the middle of the
+// output rounded down.  The same affine map as ImageCropping::transform(),
+// worked out here because the worker is built without QtGui.
+class Placement {
+public:
+    Placement(const ImageCropping &t, const QSize &output)
+    {
+        // Quarter turns are exact, as QTransform::rotate() makes them.
+        qreal a = std::fmod(t.rotation, 360.0);
+        if (a < 0)
+            a += 360;
+        qreal sine = a == 90 ? 1 : a == 270 ? -1 : a == 0 || a == 180 ? 0
+                   : std::sin(qDegreesToRadians(a));
+        qreal cosine = a == 0 ? 1 : a == 180 ? -1 : a == 90 || a == 270 ? 0
+                     : std::cos(qDegreesToRadians(a));
+        m11 = cosine * t.scaling;
+        m12 = sine * t.scaling;
+        m21 = -sine * t.scaling;
+        m22 = cosine * t.scaling;
+        QPointF middle(t.image.width() / 2.0, t.image.height() / 2.0);
+        dx = output.width() / 2 + t.translation.x() - (m11 * middle.x() + m21 * middle.y());
+        dy = output.height() / 2 + t.translation.y() - (m12 * middle.x() + m22 * middle.y());
+    }
+
+    QPointF map(const QPointF &p) const
+    {
+        return QPointF(m11 * p.x() + m21 * p.y() + dx,
+                       m12 * p.x() + m22 * p.y() + dy);
+    }
+
+    QRectF mapRect(const QRectF &r) const
+    {
+        QPointF corners[] = { map(r.topLeft()), map(r.topRight()),
+                              map(r.bottomLeft()), map(r.bottomRight()) };
+        QPointF low = corners[0], high = corners[0];
+        for (const QPointF &c : corners) {
+            low = QPointF(qMin(low.x(), c.x()), qMin(low.y(), c.y()));
+            high = QPointF(qMax(high.x(), c.x()), qMax(high.y(), c.y()));
+        }
+        return QRectF(low, high);
+    }
+
+    // From the output back to the image.
+    Placement inverted(bool *invertible) const
+    {
+        Placement i;
+        qreal det = m11 * m22 - m12 * m21;
+        *invertible = !qFuzzyIsNull(det);
+        if (!*invertible)
+            return i;
+        i.m11 = m22 / det;
+        i.m12 = -m12 / det;
+        i.m21 = -m21 / det;
+        i.m22 = m11 / det;
+        i.dx = -(i.m11 * dx + i.m21 * dy);
+        i.dy = -(i.m12 * dx + i.m22 * dy);
+        return i;
+    }
+
+private:
+    Placement() : m11(1), m12(0), m21(0), m22(1), dx(0), dy(0) {}
+
+    qreal m11, m12, m21, m22, dx, dy;
+};
+
+// The part of the image the output can show, with room for the resampling
+// filter, which reaches further the more the image is shrunk.
+static QRect neededRegion(const ImageCropping &t, const QSize &output)
+{
+    bool invertible = false;
+    Placement toImage = Placement(t, output).inverted(&invertible);
+    if (!invertible)
+        return QRect();
+    qreal margin = 3 * qMax<qreal>(1.0, 1 / std::abs(t.scaling)) + 1;
+    return toImage.mapRect(QRectF(QPointF(0, 0), output))
+            .adjusted(-margin, -margin, margin, margin).toAlignedRect()
+            & QRect(QPoint(0, 0), t.image);
+}
+
+// Moves one edge of a region outwards until the framing puts it on a pixel
+// boundary of the output.  A column if vertical, else a row; turned a quarter,
+// a column lands on a row of the output.
+static bool alignEdge(const Placement &m, bool vertical, bool turned,
+                      int *edge, int step)
+{
+    for (int v = *edge; qAbs(v - *edge) <= alignGrowth; v += step) {
+        QPointF o = m.map(vertical ? QPointF(v, 0) : QPointF(0, v));
+        qreal c = vertical != turned ? o.x() : o.y();
+        if (std::abs(c - std::round(c)) < alignTolerance) {
+            *edge = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+ExportJob::ExportJob()
+    : light("#ffffff"), memoryLimit(0), threadLimit(0) {}
+
+QStringList ExportJob::convertArguments(bool planned) const
+{
+    // The light is applied in linear light, like the multiply preview.
+    QStringList args;
+    if (memoryLimit > 0)
+        args << "-limit" << "memory" << QString("%1MiB").arg(memoryLimit >> 20)
+             << "-limit" << "map" << QString("%1MiB").arg(memoryLimit >> 19);
+    if (threadLimit > 0)
+        args << "-limit" << "thread" << QString::number(threadLimit);
+
+    QSize image = transform.image;
+    if (!image.isValid() || !size.isValid()) {
+        // Without the image's size there is no centre to turn about, so the
+        // result is fitted and centred as a whole.
+        args << workingFilename
+             << "-colorspace" << "RGB"
+             << "-virtual-pixel" << "white"
+             << "+distort" << "SRT"
+             << QString("0,0 %1 %2").arg(transform.scaling, 0, 'f', 5)
+                                    .arg(transform.rotation, 0, 'f', 5)
+             << "-write" << "mpr:src"
+             << "+delete"
+             << "-size" << sizeToString(size)
+             << QString("xc:%1").arg(light)
+             << "-colorspace" << "RGB"
+             << "mpr:src"
+             << "-gravity" << "center"
+             << "-geometry" << placeToString(transform.translation)
+             << "-compose" << "multiply"
+             << "-composite"
+             << "-colorspace" << "sRGB"
+             << outputFilename;
+        return args;
+    }
+
+    // Only the part of the working copy the output can show is read.  It is
+    // resampled no more than the framing calls for: quarter turns are exact,
+    // a plain move copies, and scaling alone is a separable resize, so long
+    // as the region's edges land on whole output pixels.  Anything else goes
+    // through the general resampler, which places every output pixel itself.
+    Placement m(transform, size);
+    QRect region(QPoint(0, 0), image);
+    if (planned)
+        region = neededRegion(transform, size);
+    if (region.isEmpty())
+        region = QRect(QPoint(0, 0), image);
+    qreal rotation = std::fmod(transform.rotation, 360.0);
+    if (rotation < 0)
+        rotation += 360;
+    int quarters = qRound(rotation / 90);
+    bool exact = planned && transform.scaling > 0
+            && nearly(rotation, quarters * 90.0);
+    quarters %= 4;
+    if (exact) {
+        // Turned exactly, so that the edges map to rows and columns.
+        ImageCropping t = transform;
+        t.rotation = quarters * 90;
+        Placement q(t, size);
+        int left = region.left(), top = region.top();
+        int right = region.right() + 1, bottom = region.bottom() + 1;
+        bool turned = quarters & 1;
+        exact = alignEdge(q, true, turned, &left, -1)
+                && alignEdge(q, true, turned, &right, 1)
+                && alignEdge(q, false, turned, &top, -1)
+                && alignEdge(q, false, turned, &bottom, 1);
+        if (exact) {
+            region = QRect(QPoint(left, top), QPoint(right - 1, bottom - 1));
+            m = q;
+        }
+    }
+
+    // An aligned region may reach past the image, where the general
+    // resampler would see white; so does the fast path.
+    QRect read = region & QRect(QPoint(0, 0), image);
+    QString input = workingFilename;
+    if (read.size() != image)
+        input += QString("[%1x%2+%3+%4]").arg(read.width()).arg(read.height())
+                                          .arg(read.x()).arg(read.y());
+    args << input;
+    if (input != workingFilename)
+        args << "+repage";
+    if (read != region)
+        args << "-background" << "white"
+             << "-extent" << sizeToString(region.size())
+                             + offsetToString(region.topLeft() - read.topLeft());
+    args << "-colorspace" << "RGB";
+
+    QPoint place;
+    if (exact) {
+        QRect target = m.mapRect(QRectF(region)).toRect();
+        QSize turned = region.size();
+        if (quarters)
+            args << "-rotate" << QString::number(quarters * 90);
+        if (quarters & 1)
+            turned.transpose();
+        if (turned != target.size())
+            args << "-resize" << QString("%1x%2!").arg(qMax(1, target.width()))
+                                                  .arg(qMax(1, target.height()));
+        place = target.topLeft();
+    } else {
+        // The region's middle, and where the framing puts it.
+        QPointF middle(region.width() / 2.0, region.height() / 2.0);
+        QPointF to = m.map(QRectF(region).center());
+        args << "-virtual-pixel" << "white"
+             << "-define" << QString("distort:viewport=%1+0+0").arg(sizeToString(size))
+             << "-distort" << "SRT"
+             << QString("%1,%2 %3 %4 %5,%6").arg(middle.x(), 0, 'f', 5)
+                                            .arg(middle.y(), 0, 'f', 5)
+                                            .arg(transform.scaling, 0, 'f', 5)
+                                            .arg(transform.rotation, 0, 'f', 5)
+                                            .arg(to.x(), 0, 'f', 5)
+                                            .arg(to.y(), 0, 'f', 5);
+    }
+    // Placed by the offset alone, whatever canvas the operators left behind.
+    args << "+repage"
+         << "-write" << "mpr:src"
+         << "+delete"
+         << "-size" << sizeToString(size)
+         << QString("xc:%1").arg(light)
+         << "-colorspace" << "RGB"
+         << "mpr:src"
+         << "-geometry" << offsetToString(place)
+         << "-compose" << "multiply"
+         << "-composite"
+         << "-colorspace" << "sRGB"
+         << outputFilename;
+    return args;
+}
+
+bool ExportJob::verifyOutput(QString *error) const
+{
+    // Only the header is read: enough to catch a missing, truncated or
+    // misshapen output without decoding it.  Exports are PNG, which gives
+    // its size in the IHDR chunk straight after the signature; other
+    // formats are only checked for being there.
+    QFileInfo info(outputFilename);
+    if (!info.exists() || info.size() == 0) {
+        *error = "the output is missing or empty";
+        return false;
+    }
+    if (info.suffix().compare("png", Qt::CaseInsensitive) != 0)
+        return true;
+    QFile f(outputFilename);
+    QByteArray header = f.open(QFile::ReadOnly) ? f.read(24) : QByteArray();
+    if (header.size() < 24 || !header.startsWith("\x89PNG\r\n\x1a\n")
+            || header.mid(12, 4) != "IHDR") {
+        *error = "the output cannot be read as a PNG";
+        return false;
+    }
+    const uchar *ihdr = reinterpret_cast<const uchar *>(header.constData());
+    QSize written(qFromBigEndian<quint32>(ihdr + 16),
+                  qFromBigEndian<quint32>(ihdr + 20));
+    if (written != size) {
+        *error = QString("the output is %1, not %2")
+                .arg(sizeToString(written), sizeToString(size));
+        return false;
+    }
+    return true;
+}
+
+QByteArray ExportJob::fingerprint() const
+{
+    // The convert invocation with the file names taken out covers the framing,
+    // size, light and the pipeline itself, including the output format.
+    ExportJob j = *this;
+    j.memoryLimit = 0;
+    j.threadLimit = 0;
+    j.workingFilename = "working";
+    j.outputFilename = "output." + QFileInfo(outputFilename).suffix();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(sourceHash);
+    hash.addData(provenance.toUtf8());
+    hash.addData(j.convertArguments().join('\n').toUtf8());
+    return hash.result();
+}
+
+QJsonObject ExportJob::toJson() const
+{
+    QJsonObject t;
+    t["image_width"] = transform.image.width();
+    t["image_height"] = transform.image.height();
+    t["scaling"] = transform.scaling;
+    t["rotation"] = transform.rotation;
+    t["x"] = transform.translation.x();
+    t["y"] = transform.translation.y();
+
+    QJsonObject j;
+    j["source"] = sourceFilename;
+    j["working"] = workingFilename;
+    j["output"] = outputFilename;
+    j["transform"] = t;
+    j["width"] = size.width();
+    j["height"] = size.height();
+    j["light"] = light;
+    j["memory_limit"] = double(memoryLimit);
+    j["source_hash"] = QString::fromLatin1(sourceHash.toHex());
+    j["provenance"] = provenance;
+    return j;
+}
+
+ExportJob ExportJob::fromJson(const QJsonObject &json)
+{
+    QJsonObject t = json["transform"].toObject();
+    ExportJob job;
+    job.sourceFilename = json["source"].toString();
+    job.workingFilename = json["working"].toString();
+    job.outputFilename = json["output"].toString();
+    job.transform.image = QSize(t["image_width"].toInt(), t["image_height"].toInt());
+    job.transform.scaling = t["scaling"].toDouble(1.0);
+    job.transform.rotation = t["rotation"].toDouble();
+    job.transform.translation = QPointF(t["x"].toDouble(), t["y"].toDouble());
+    job.size = QSize(json["width"].toInt(), json["height"].toInt());
+    job.light = json["light"].toString("#ffffff").toLower();
+    job.memoryLimit = json["memory_limit"].toDouble();
+    job.sourceHash = QByteArray::fromHex(json["source_hash"].toString().toLatin1());
+    job.provenance = json["provenance"].toString();
+    return job;
+}
@@ -0,0 +1,40 @@
+#ifndef EXPORTJOB_H
+#define EXPORTJOB_H
+
+#include <QJsonObject>
+#include <QMetaType>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include "imagecropping.h"
+
+// Everything needed to render one framed image to its output file.
+class ExportJob {
+public:
+    ExportJob();
+
+    // Unplanned, the whole working copy goes through the general resampler;
+    // the planner's shortcuts should come out the same.
+    QStringList convertArguments(bool planned = true) const;
+    bool verifyOutput(QString *error) const;
+    QByteArray fingerprint() const;
+    QJsonObject toJson() const;
+    static ExportJob fromJson(const QJsonObject &json);
+
+    QString sourceFilename;
+    QString workingFilename;
+    QString outputFilename;
+    ImageCropping transform;
+    QSize size;
+    // The light's #rrggbb name.
+    QString light;
+    qint64 memoryLimit;
+    int threadLimit;
+    // What the output depends on besides the arguments: the source contents
+    // and how the working copy was made from it.
+    QByteArray sourceHash;
+    QString provenance;
+};
+Q_DECLARE_METATYPE(ExportJob)
+
+#endif // EXPORTJOB_H
@@ -0,0 +1,288 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QProcess>
+#include <QRunnable>
+#include <QTimer>
+#include "exportqueue.h"
+#include "exportindex.h"
+#include "exportspool.h"
+#include "memorybudget.h"
+#include "processgovernor.h"
+
+// Attempts at a job before it is reported as failed, and the pause before the
+// first retry, doubled for each one after.
+static const int maxAttempts = 4;
+static const int retryDelay = 2000;
+
+class HashTask : public QRunnable {
+public:
+    HashTask(ExportQueue *owner, const ExportJob &job, const QString &spoolFolder)
+        : owner(owner), job(job), spoolFolder(spoolFolder) {}
+
+    void run()
+    {
+        job.sourceHash = ExportIndex::hashFile(job.sourceFilename);
+        QMetaObject::invokeMethod(owner, "hashed", Qt::QueuedConnection,
+                                  Q_ARG(ExportJob, job), Q_ARG(QString, spoolFolder));
+    }
+
+private:
+    ExportQueue *owner;
+    ExportJob job;
+    QString spoolFolder;
+};
+
+// Writes a job into the spool, with its own copy of the working file, which
+// after a doubling can be hundreds of megabytes going to a network share.
+class SpoolTask : public QRunnable {
+public:
+    SpoolTask(ExportQueue *owner, const ExportJob &job, const QString &spoolFolder)
+        : owner(owner), job(job), spoolFolder(spoolFolder) {}
+
+    void run()
+    {
+        ExportSpool spool(spoolFolder);
+        bool ok = spool.create() && spool.submit(job, true);
+        QMetaObject::invokeMethod(owner, "submitted", Qt::QueuedConnection,
+                                  Q_ARG(ExportJob, job), Q_ARG(bool, ok));
+    }
+
+private:
+    ExportQueue *owner;
+    ExportJob job;
+    QString spoolFolder;
+};
+
+
+
+ExportQueue::ExportQueue(QObject *parent)
+    : QObject(parent), hashing(0), concurrency(1), limit(1), nextHelperJob(0)
+{
+    qRegisterMetaType<ExportJob>();
+    // Hashing is disk bound; more than one at a time only makes them seek.
+    hashPool.setMaxThreadCount(1);
+    connect(&magick, &MagickPool::finished, this, &ExportQueue::helper_finished);
+    connect(&magick, &MagickPool::lost, this, &ExportQueue::helper_lost);
+    clock.start();
+}
+
+ExportQueue::~ExportQueue()
+{
+    hashPool.clear();
+    hashPool.waitForDone();
+    // Exports already under way are left to finish on their own.
+    for (QProcess *p : processes.keys()) {
+        p->disconnect(this);
+        p->setParent(0);
+        MemoryBudget::instance()->remove(processes[p].budgetId);
+    }
+    for (const Running &r : helperJobs)
+        MemoryBudget::instance()->remove(r.budgetId);
+}
+
+void ExportQueue::setConcurrency(int jobs)
+{
+    concurrency = limit = qMax(1, jobs);
+    magick.setSize(concurrency);
+    startNext();
+}
+
+void ExportQueue::enqueue(const ExportJob &job)
+{
+    hash(job, QString());
+}
+
+void ExportQueue::spool(const ExportJob &job, const QString &spoolFolder)
+{
+    hash(job, spoolFolder);
+}
+
+int ExportQueue::running() const
+{
+    return processes.count() + helperJobs.count();
+}
+
+int ExportQueue::waiting() const
+{
+    return hashing + pending.count();
+}
+
+void ExportQueue::hash(const ExportJob &job, const QString &spoolFolder)
+{
+    // A stat decides whether the last hash still holds; only a source that is
+    // new or has changed is read in full, and never on this thread.  A job
+    // handed back by spool() comes in already hashed.
+    ExportJob j = job;
+    if (j.sourceHash.isEmpty())
+        j.sourceHash = ExportIndex::forFolder(QFileInfo(job.outputFilename).absolutePath())
+                ->cachedSourceHash(job.sourceFilename, job.outputFilename);
+    hashing++;
+    if (!j.sourceHash.isEmpty())
+        hashed(j, spoolFolder);
+    else
+        hashPool.start(new HashTask(this, j, spoolFolder));
+}
+
+void ExportQueue::hashed(ExportJob job, QString spoolFolder)
+{
+    ExportIndex *exported = ExportIndex::forFolder(
+                QFileInfo(job.outputFilename).absolutePath());
+    if (exported->isUnchanged(job)) {
+        hashing--;
+        emit finished(job, Unchanged, 0, QString());
+        return;
+    }
+    if (!spoolFolder.isEmpty()) {
+        // Still waiting, as far as anyone asks, until the copy is in.
+        hashPool.start(new SpoolTask(this, job, spoolFolder));
+        return;
+    }
+    hashing--;
+    Pending p;
+    p.job = job;
+    p.attempt = 0;
+    p.notBefore = 0;
+    pending.append(p);
+    startNext();
+}
+
+void ExportQueue::submitted(ExportJob job, bool ok)
+{
+    hashing--;
+    emit spooled(job, ok);
+}
+
+void ExportQueue::startNext()
+{
+    MemoryBudget *budget = MemoryBudget::instance();
+    while (running() < qMin(concurrency, limit)) {
+        // Jobs waiting out a retry pause let the ones behind them go first.
+        int next = 0;
+        qint64 now = clock.elapsed();
+        while (next < pending.count() && pending.at(next).notBefore > now)
+            next++;
+        if (next == pending.count())
+            break;
+        Pending p = pending.takeAt(next);
+        ExportJob job = p.job;
+
+        // Let imagemagick spill to disk rather than push us past the budget,
+        // and account for what it will hold while it runs (Q16 RGBA, source +
+        // canvas).
+        QSize workingSize = QImageReader(job.workingFilename).size();
+        qint64 estimate = (qint64(workingSize.width()) * workingSize.height()
+                           + qint64(job.size.width()) * job.size.height()) * 8;
+        // After a failure fewer jobs run at once, and each gets the larger
+        // share that leaves.
+        job.memoryLimit = qMax<qint64>(qint64(256) << 20,
+                                       budget->available() / qMin(concurrency, limit));
+        job.threadLimit = ProcessGovernor::instance()->threadLimit();
+        Running r;
+        r.job = job;
+        r.attempt = p.attempt;
+        r.started = clock.elapsed();
+        r.budgetId = budget->add("Export " + QFileInfo(job.sourceFilename).fileName(),
+                                 MemoryBudget::Current);
+        budget->resize(r.budgetId, estimate);
+
+        int id = nextHelperJob++;
+        if (magick.run(id, job.convertArguments()))
+            helperJobs.insert(id, r);
+        else
+            startProcess(r);
+    }
+}
+
+void ExportQueue::startProcess(const Running &r)
+{
+    QProcess *p = ProcessGovernor::instance()->create(this);
+    p->setProgram("convert");
+    p->setArguments(r.job.convertArguments());
+    connect(p, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, [this, p](int exitCode, QProcess::ExitStatus status) {
+        process_finished(p, status == QProcess::CrashExit ? -1 : exitCode);
+    });
+    connect(p, &QProcess::errorOccurred, this, [this, p](QProcess::ProcessError e) {
+        if (e == QProcess::FailedToStart)
+            process_finished(p, -1);
+    });
+    processes.insert(p, r);
+    p->start();
+}
+
+void ExportQueue::process_finished(QProcess *process, int exitCode)
+{
+    auto it = processes.find(process);
+    if (it == processes.end())
+        return;
+    Running r = *it;
+    processes.erase(it);
+    process->deleteLater();
+    QString error = QString::fromLocal8Bit(process->readAllStandardError()).trimmed();
+    if (exitCode != 0 && error.isEmpty())
+        error = exitCode < 0 ? process->errorString()
+                             : QString("convert exited with %1").arg(exitCode);
+    complete(r, exitCode == 0, error);
+}
+
+void ExportQueue::helper_finished(int id, bool ok, QString error)
+{
+    auto it = helperJobs.find(id);
+    if (it == helperJobs.end())
+        return;
+    Running r = *it;
+    helperJobs.erase(it);
+    complete(r, ok, error);
+}
+
+void ExportQueue::helper_lost(int id)
+{
+    // Whatever took the helper down may be peculiar to it; convert gets a go.
+    auto it = helperJobs.find(id);
+    if (it == helperJobs.end())
+        return;
+    Running r = *it;
+    helperJobs.erase(it);
+    startProcess(r);
+}
+
+void ExportQueue::complete(const Running &r, bool ok, const QString &error)
+{
+    MemoryBudget::instance()->remove(r.budgetId);
+    QString why = error;
+    if (ok && !r.job.verifyOutput(&why)) {
+        // Whatever convert wrote is not the export; nothing else should
+        // mistake it for one.
+        QFile::remove(r.job.outputFilename);
+        ok = false;
+    }
+    qint64 msecs = clock.elapsed() - r.started;
+
+    if (ok) {
+        ExportIndex::forFolder(QFileInfo(r.job.outputFilename).absolutePath())
+                ->record(r.job);
+        // Back up towards the configured number, one success at a time.
+        limit = qMin(concurrency, limit + 1);
+        emit finished(r.job, Exported, msecs, QString());
+    } else if (r.attempt + 1 < maxAttempts) {
+        // Failures under load are mostly convert running out of memory, so
+        // the retry waits and fewer exports share what there is.
+        qWarning("export of %s failed, retrying: %s",
+                 qPrintable(r.job.sourceFilename), qPrintable(why));
+        limit = qMax(1, qMin(concurrency, limit) / 2);
+        int delay = retryDelay << r.attempt;
+        Pending p;
+        p.job = r.job;
+        p.attempt = r.attempt + 1;
+        p.notBefore = clock.elapsed() + delay;
+        pending.append(p);
+        QTimer::singleShot(delay, this, SLOT(startNext()));
+        emit retrying(r.job, p.attempt, why, delay);
+    } else {
+        qWarning("export of %s failed: %s", qPrintable(r.job.sourceFilename),
+                 qPrintable(why));
+        emit finished(r.job, Failed, msecs, why);
+    }
+    startNext();
+}
@@ -0,0 +1,80 @@
+#ifndef EXPORTQUEUE_H
+#define EXPORTQUEUE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QThreadPool>
+#include "exportjob.h"
+#include "magickpool.h"
+
+class QProcess;
+
+// Runs convert for export jobs, a bounded number at a time, in the
+// darkcropper-magick helpers when they are installed and as separate convert
+// processes otherwise.  Sources are hashed for the export index on a worker
+// thread first, and jobs whose output is already up to date are reported as
+// skipped without running anything.  Every output is checked against the job
+// before it counts; failed jobs are retried after a growing pause, with fewer
+// exports at once, and only reported as failed once out of attempts.
+class ExportQueue : public QObject {
+    Q_OBJECT
+public:
+    enum Result { Exported, Failed, Unchanged };
+
+    ExportQueue(QObject *parent = 0);
+    ~ExportQueue();
+    void setConcurrency(int jobs);
+    void enqueue(const ExportJob &job);
+    // Hashes the source as enqueue() does, then writes the job and a copy of
+    // its working file into the spool folder for the export workers, all off
+    // this thread, and reports through spooled().
+    void spool(const ExportJob &job, const QString &spoolFolder);
+    int running() const;
+    int waiting() const;
+
+signals:
+    void finished(ExportJob job, ExportQueue::Result result, qint64 msecs,
+                  QString error);
+    void retrying(ExportJob job, int attempt, QString error, int delayMsecs);
+    void spooled(ExportJob job, bool ok);
+
+private slots:
+    void hashed(ExportJob job, QString spoolFolder);
+    void submitted(ExportJob job, bool ok);
+    void process_finished(QProcess *process, int exitCode);
+    void startNext();
+    void helper_finished(int id, bool ok, QString error);
+    void helper_lost(int id);
+
+private:
+    struct Pending {
+        ExportJob job;
+        int attempt;
+        qint64 notBefore;
+    };
+    struct Running {
+        ExportJob job;
+        int attempt;
+        qint64 started;
+        int budgetId;
+    };
+
+    void hash(const ExportJob &job, const QString &spoolFolder);
+    void startProcess(const Running &r);
+    void complete(const Running &r, bool ok, const QString &error);
+
+    QThreadPool hashPool;
+    int hashing;
+    int concurrency;
+    int limit;
+    QList<Pending> pending;
+    QHash<QProcess*, Running> processes;
+    MagickPool magick;
+    QHash<int, Running> helperJobs;
+    int nextHelperJob;
+    QElapsedTimer clock;
+};
+
+#endif // EXPORTQUEUE_H
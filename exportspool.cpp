@@ -0,0 +1,170 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QUuid>
+#include "exportspool.h"
+#include "jsonfile.h"
+
+// Tries a job gets, on whichever workers claim it, before it is given up.
+static const int maxAttempts = 3;
+
+ExportSpool::ExportSpool(const QString &folder)
+    : folder_(folder)
+{
+}
+
+void ExportSpool::setFolder(const QString &folder)
+{
+    folder_ = folder;
+}
+
+QString ExportSpool::folder() const
+{
+    return folder_;
+}
+
+bool ExportSpool::create()
+{
+    if (folder_.isEmpty())
+        return false;
+    for (const char *sub : { "tmp", "new", "claimed", "done", "failed",
+                             "inputs", "workers" })
+        if (!QDir().mkpath(path(sub)))
+            return false;
+    return true;
+}
+
+bool ExportSpool::submit(ExportJob job, bool copyWorkingFile, QString *id)
+{
+    QString jobId = QDateTime::currentDateTimeUtc().toString("yyyyMMddHHmmsszzz")
+            + "-" + QUuid::createUuid().toString().mid(1, 8);
+    if (copyWorkingFile && job.workingFilename != job.sourceFilename) {
+        // Scratch copies live on this host's tmpfs; workers elsewhere need
+        // them in the spool.
+        QString input = QString("%1/%2.%3").arg(path("inputs")).arg(jobId)
+                .arg(QFileInfo(job.workingFilename).suffix());
+        if (!QFile::copy(job.workingFilename, input))
+            return false;
+        job.workingFilename = input;
+    }
+    QJsonObject manifest = job.toJson();
+    manifest["id"] = jobId;
+    manifest["submitted"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    manifest["submitted_by"] = workerName();
+    if (!JsonFile::write(path("tmp"), path("new") + "/" + jobId + ".json", manifest))
+        return false;
+    if (id)
+        *id = jobId;
+    return true;
+}
+
+bool ExportSpool::claim(const QString &worker, Claim *claim)
+{
+    QDir waiting(path("new"));
+    for (const QString &name : waiting.entryList({"*.json"}, QDir::Files, QDir::Name)) {
+        QString id = name.left(name.length() - 5);
+        QString claimed = QString("%1/%2@%3.json").arg(path("claimed")).arg(id).arg(worker);
+        // Whoever renames first owns the job; everyone else gets an error.
+        if (!QFile::rename(waiting.filePath(name), claimed))
+            continue;
+        QJsonObject manifest = JsonFile::read(claimed);
+        if (manifest.isEmpty()) {
+            QFile::rename(claimed, path("failed") + "/" + name);
+            continue;
+        }
+        claim->id = id;
+        claim->path = claimed;
+        claim->job = ExportJob::fromJson(manifest);
+        return true;
+    }
+    return false;
+}
+
+void ExportSpool::finish(const Claim &claim, bool ok, const QJsonObject &result)
+{
+    QJsonObject manifest = JsonFile::read(claim.path);
+    QJsonObject r = result;
+    r["ok"] = ok;
+    r["finished"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    manifest["result"] = r;
+    // A failure goes back in new/, for this or another worker, until it has
+    // failed maxAttempts times.  Then it is given up along with its input;
+    // its output is gone too, so the watch folder offers the source again.
+    int attempts = manifest.value("attempts").toInt() + 1;
+    manifest["attempts"] = attempts;
+    QString to = ok ? "done" : attempts < maxAttempts ? "new" : "failed";
+    JsonFile::write(path("tmp"), QString("%1/%2.json").arg(path(to)).arg(claim.id),
+                    manifest);
+    QFile::remove(claim.path);
+    if (to != "new" && claim.job.workingFilename.startsWith(path("inputs") + "/"))
+        QFile::remove(claim.job.workingFilename);
+}
+
+int ExportSpool::requeueStale(int maxAgeSecs)
+{
+    QDir claimedDir(path("claimed"));
+    int requeued = 0;
+    for (const QString &name : claimedDir.entryList({"*@*.json"}, QDir::Files)) {
+        int at = name.lastIndexOf('@');
+        QString id = name.left(at);
+        QString worker = name.mid(at + 1, name.length() - at - 6);
+        if (heartbeats.isAlive(path("workers") + "/" + worker + ".json", maxAgeSecs))
+            continue;
+        if (QFile::rename(claimedDir.filePath(name), path("new") + "/" + id + ".json"))
+            requeued++;
+    }
+    return requeued;
+}
+
+void ExportSpool::heartbeat(const QString &worker, const QJsonObject &state)
+{
+    QJsonObject beat = state;
+    beat["worker"] = worker;
+    // The worker's own clock, only ever compared with its previous beat.
+    beat["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    JsonFile::write(path("tmp"), path("workers") + "/" + worker + ".json", beat);
+}
+
+void ExportSpool::retire(const QString &worker)
+{
+    QFile::remove(path("workers") + "/" + worker + ".json");
+}
+
+QList<QJsonObject> ExportSpool::workers(int maxAgeSecs) const
+{
+    QList<QJsonObject> alive;
+    QDir d(path("workers"));
+    for (const QFileInfo &info : d.entryInfoList({"*.json"}, QDir::Files))
+        if (heartbeats.isAlive(info.absoluteFilePath(), maxAgeSecs))
+            alive << JsonFile::read(info.absoluteFilePath());
+    return alive;
+}
+
+int ExportSpool::waiting() const
+{
+    return QDir(path("new")).entryList({"*.json"}, QDir::Files).count();
+}
+
+int ExportSpool::claimed() const
+{
+    return QDir(path("claimed")).entryList({"*.json"}, QDir::Files).count();
+}
+
+int ExportSpool::failed() const
+{
+    return QDir(path("failed")).entryList({"*.json"}, QDir::Files).count();
+}
+
+QString ExportSpool::workerName()
+{
+    return QString("%1-%2").arg(QSysInfo::machineHostName())
+            .arg(QCoreApplication::applicationPid());
+}
+
+QString ExportSpool::path(const QString &sub) const
+{
+    return folder_ + "/" + sub;
+}
@@ -0,0 +1,55 @@
+#ifndef EXPORTSPOOL_H
+#define EXPORTSPOOL_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include "exportjob.h"
+#include "heartbeatmonitor.h"
+
+// A directory of export manifests shared between the GUI and any number of
+// darkcropper-worker processes, possibly on other hosts over a shared
+// filesystem.  Every state change is a rename within the spool, so exactly one
+// worker wins each job:
+//   new/<id>.json                 waiting
+//   claimed/<id>@<worker>.json    being rendered
+//   done/<id>.json, failed/<id>.json   manifest plus a "result" object; a
+//                                 failure is retried a few times before failed/
+//   inputs/<id>.<ext>             working copies the workers cannot otherwise see
+//   workers/<worker>.json         heartbeats, judged by HeartbeatMonitor
+class ExportSpool {
+public:
+    struct Claim {
+        QString id;
+        QString path;
+        ExportJob job;
+    };
+
+    ExportSpool(const QString &folder = QString());
+    void setFolder(const QString &folder);
+    QString folder() const;
+    bool create();
+
+    bool submit(ExportJob job, bool copyWorkingFile, QString *id = NULL);
+    bool claim(const QString &worker, Claim *claim);
+    void finish(const Claim &claim, bool ok, const QJsonObject &result);
+    int requeueStale(int maxAgeSecs);
+
+    void heartbeat(const QString &worker, const QJsonObject &state);
+    void retire(const QString &worker);
+    QList<QJsonObject> workers(int maxAgeSecs) const;
+    int waiting() const;
+    int claimed() const;
+    int failed() const;
+
+    static QString workerName();
+
+private:
+    QString path(const QString &sub) const;
+
+    QString folder_;
+    mutable HeartbeatMonitor heartbeats;
+};
+
+#endif // EXPORTSPOOL_H
@@ -0,0 +1,103 @@
+#include <QMouseEvent>
+#include <QPainter>
+#include "filmstrip.h"
+#include "thumbnailcache.h"
+
+static const int cellSize = ThumbnailCache::ThumbnailSize / 2 + 8;
+
+Filmstrip::Filmstrip(QWidget *parent)
+    : QWidget(parent)
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    connect(ThumbnailCache::instance(), &ThumbnailCache::thumbnailReady,
+            this, &Filmstrip::thumbnailReady);
+}
+
+void Filmstrip::setFiles(const QStringList &previous, const QString &current,
+                         const QStringList &next)
+{
+    this->previous = previous;
+    this->current = current;
+    this->next = next;
+
+    // Nearest first, so that what is about to be cropped shows up soonest.
+    QStringList wanted;
+    if (!current.isEmpty())
+        wanted << current;
+    for (int i = 0; i < qMax(previous.count(), next.count()); i++) {
+        if (i < next.count())
+            wanted << next.at(i);
+        if (i < previous.count())
+            wanted << previous.at(previous.count() - 1 - i);
+    }
+    ThumbnailCache::instance()->request(wanted);
+    update();
+}
+
+QSize Filmstrip::sizeHint() const
+{
+    return QSize(cellSize * 11, cellSize);
+}
+
+void Filmstrip::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter p(this);
+    p.fillRect(rect(), QColor(0, 0, 0, 160));
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+    ThumbnailCache *cache = ThumbnailCache::instance();
+    QStringList all = files();
+    for (int i = 0; i < all.count(); i++) {
+        if (all.at(i).isEmpty())
+            continue;
+        QRect cell = cellRect(i);
+        QRect inner = cell.adjusted(4, 4, -4, -4);
+        QImage thumb = cache->thumbnail(all.at(i));
+        p.setOpacity(i < previous.count() ? 0.4 : 1.0);
+        if (thumb.isNull()) {
+            p.fillRect(inner, QColor(64, 64, 64));
+        } else {
+            QSize fitted = thumb.size().scaled(inner.size(), Qt::KeepAspectRatio);
+            QRect target(QPoint(0, 0), fitted);
+            target.moveCenter(inner.center());
+            p.drawImage(target, thumb);
+        }
+        if (i == previous.count()) {
+            p.setOpacity(1.0);
+            p.setPen(QPen(QColor(224, 224, 224), 2));
+            p.setBrush(Qt::NoBrush);
+            p.drawRect(cell.adjusted(1, 1, -1, -1));
+        }
+    }
+}
+
+void Filmstrip::mousePressEvent(QMouseEvent *event)
+{
+    QStringList all = files();
+    for (int i = 0; i < all.count(); i++) {
+        if (cellRect(i).contains(event->pos()) && !all.at(i).isEmpty()) {
+            emit activated(all.at(i));
+            return;
+        }
+    }
+}
+
+void Filmstrip::thumbnailReady(QString filename)
+{
+    if (filename == current || previous.contains(filename)
+            || next.contains(filename))
+        update();
+}
+
+QRect Filmstrip::cellRect(int index) const
+{
+    // The current file sits in the middle of the strip whatever the counts.
+    int centre = (width() - cellSize) / 2;
+    int x = centre + (index - previous.count()) * cellSize;
+    return QRect(x, (height() - cellSize) / 2, cellSize, cellSize);
+}
+
+QStringList Filmstrip::files() const
+{
+    return QStringList(previous) << current << next;
+}
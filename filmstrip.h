@@ -0,0 +1,36 @@
+#ifndef FILMSTRIP_H
+#define FILMSTRIP_H
+
+#include <QStringList>
+#include <QWidget>
+
+// A row of thumbnails: the files already dealt with on the left, dimmed, the
+// current one outlined, and the upcoming ones on the right.
+class Filmstrip : public QWidget {
+    Q_OBJECT
+public:
+    Filmstrip(QWidget *parent = 0);
+    void setFiles(const QStringList &previous, const QString &current,
+                  const QStringList &next);
+    QSize sizeHint() const;
+
+signals:
+    void activated(QString filename);
+
+protected:
+    void paintEvent(QPaintEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+
+private slots:
+    void thumbnailReady(QString filename);
+
+private:
+    QRect cellRect(int index) const;
+    QStringList files() const;
+
+    QStringList previous;
+    QString current;
+    QStringList next;
+};
+
+#endif // FILMSTRIP_H
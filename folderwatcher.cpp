@@ -0,0 +1,93 @@
+#include <QDir>
+#include <QFileInfo>
+#include "folderwatcher.h"
+
+FolderWatcher::FolderWatcher(QObject *parent)
+    : QObject(parent), nameFilters({"*.png", "*.jpg", "*.jpeg"})
+{
+    // A burst of writes produces a burst of notifications; scan once for all.
+    rescanTimer.setSingleShot(true);
+    rescanTimer.setInterval(200);
+    settleTimer.setSingleShot(true);
+    settleTimer.setInterval(2000);
+    connect(&watcher, &QFileSystemWatcher::directoryChanged,
+            &rescanTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&rescanTimer, &QTimer::timeout, this, &FolderWatcher::rescan);
+    connect(&settleTimer, &QTimer::timeout, this, &FolderWatcher::checkPending);
+}
+
+void FolderWatcher::setFolder(const QString &folder)
+{
+    if (!watcher.directories().isEmpty())
+        watcher.removePaths(watcher.directories());
+    rescanTimer.stop();
+    settleTimer.stop();
+    pending.clear();
+    known.clear();
+    folder_ = folder;
+    if (folder.isEmpty() || !QDir(folder).exists())
+        return;
+
+    // Whatever is already there is left to the Send button.
+    QDir d(folder);
+    for (const QFileInfo &info : d.entryInfoList(nameFilters, QDir::Files | QDir::NoDotAndDotDot))
+        known.insert(info.absoluteFilePath());
+    watcher.addPath(folder);
+}
+
+void FolderWatcher::setSettleTime(int msec)
+{
+    settleTimer.setInterval(msec);
+}
+
+void FolderWatcher::setNameFilters(const QStringList &filters)
+{
+    nameFilters = filters;
+}
+
+QString FolderWatcher::folder() const
+{
+    return folder_;
+}
+
+void FolderWatcher::rescan()
+{
+    QDir d(folder_);
+    for (const QFileInfo &info : d.entryInfoList(nameFilters, QDir::Files | QDir::NoDotAndDotDot)) {
+        QString path = info.absoluteFilePath();
+        if (known.contains(path) || pending.contains(path))
+            continue;
+        pending.insert(path, { info.size(), info.lastModified() });
+    }
+    if (!pending.isEmpty() && !settleTimer.isActive())
+        settleTimer.start();
+}
+
+void FolderWatcher::checkPending()
+{
+    QStringList ready;
+    QDateTime settled = QDateTime::currentDateTime()
+            .addMSecs(-settleTimer.interval());
+    for (auto it = pending.begin(); it != pending.end(); ) {
+        QFileInfo info(it.key());
+        if (!info.exists()) {
+            it = pending.erase(it);
+            continue;
+        }
+        if (info.size() > 0 && info.size() == it->size
+                && info.lastModified() == it->modified
+                && info.lastModified() <= settled) {
+            ready << it.key();
+            known.insert(it.key());
+            it = pending.erase(it);
+            continue;
+        }
+        it->size = info.size();
+        it->modified = info.lastModified();
+        ++it;
+    }
+    if (!pending.isEmpty())
+        settleTimer.start();
+    if (!ready.isEmpty())
+        emit filesReady(ready);
+}
@@ -0,0 +1,45 @@
+#ifndef FOLDERWATCHER_H
+#define FOLDERWATCHER_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+// Reports files which appear in a folder once they have stopped changing, so
+// that images still being written by a scraper are never picked up.
+class FolderWatcher : public QObject {
+    Q_OBJECT
+public:
+    FolderWatcher(QObject *parent = 0);
+    void setFolder(const QString &folder);
+    void setSettleTime(int msec);
+    void setNameFilters(const QStringList &filters);
+    QString folder() const;
+
+signals:
+    void filesReady(QStringList files);
+
+private slots:
+    void rescan();
+    void checkPending();
+
+private:
+    struct Pending {
+        qint64 size;
+        QDateTime modified;
+    };
+
+    QFileSystemWatcher watcher;
+    QTimer rescanTimer;
+    QTimer settleTimer;
+    QString folder_;
+    QStringList nameFilters;
+    QHash<QString, Pending> pending;
+    QSet<QString> known;
+};
+
+#endif // FOLDERWATCHER_H
@@ -0,0 +1,56 @@
+#include "framescheduler.h"
+
+FrameScheduler::FrameScheduler(QObject *parent)
+    : QObject(parent), refreshRate(60), rateCap(0), lastFrame(-1000000),
+      dueTime(0)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &FrameScheduler::tick);
+    clock.start();
+}
+
+void FrameScheduler::setRefreshRate(qreal hz)
+{
+    if (hz > 0)
+        refreshRate = hz;
+}
+
+void FrameScheduler::setRateCap(qreal hz)
+{
+    rateCap = hz;
+}
+
+int FrameScheduler::interval()
+{
+    qreal hz = refreshRate;
+    if (rateCap > 0 && rateCap < hz)
+        hz = rateCap;
+    return qMax(1, qRound(1000 / hz));
+}
+
+qint64 FrameScheduler::now()
+{
+    return clock.elapsed();
+}
+
+void FrameScheduler::requestFrame()
+{
+    requestFrameIn(0);
+}
+
+void FrameScheduler::requestFrameIn(int msec)
+{
+    qint64 current = clock.elapsed();
+    qint64 due = qMax(current + msec, lastFrame + interval());
+    if (timer.isActive() && due >= dueTime)
+        return;
+    dueTime = due;
+    timer.start(int(qMax<qint64>(0, due - current)));
+}
+
+void FrameScheduler::tick()
+{
+    lastFrame = clock.elapsed();
+    emit frame(lastFrame);
+}
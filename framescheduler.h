@@ -0,0 +1,38 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+
+// Paces repaints to the display refresh rate (or a lower cap).  Requests made
+// between two frames collapse into one, and nothing runs while idle.
+class FrameScheduler : public QObject {
+    Q_OBJECT
+public:
+    FrameScheduler(QObject *parent = 0);
+    void setRefreshRate(qreal hz);
+    void setRateCap(qreal hz);
+    int interval();
+    qint64 now();
+
+public slots:
+    void requestFrame();
+    void requestFrameIn(int msec);
+
+signals:
+    void frame(qint64 now);
+
+private slots:
+    void tick();
+
+private:
+    QTimer timer;
+    QElapsedTimer clock;
+    qreal refreshRate;
+    qreal rateCap;
+    qint64 lastFrame;
+    qint64 dueTime;
+};
+
+#endif // FRAMESCHEDULER_H
@@ -0,0 +1,174 @@
+#include <QDialogButtonBox>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QRunnable>
+#include <QThread>
+#include <QVBoxLayout>
+#include "groupreview.h"
+#include "linearmultiply.h"
+
+// Members rendered either side of the one shown; the rest are dropped.
+static const int renderAhead = 4;
+static const int renderBehind = 1;
+static const QSize previewBox(960, 600);
+
+class ReviewTask : public QRunnable {
+public:
+    ReviewTask(GroupReview *owner, int index, const GroupReview::Member &member,
+               const QSize &outputSize, const QSize &previewSize,
+               const QColor &light)
+        : owner(owner), index(index), member(member), outputSize(outputSize),
+          previewSize(previewSize), light(light) {}
+
+    void run()
+    {
+        // No more of the source is decoded than the preview can show.
+        qreal scale = previewSize.width() / qreal(outputSize.width());
+        QImageReader reader(member.filename);
+        QSize size = reader.size();
+        qreal decode = qMin<qreal>(1.0, scale * member.transform.scaling);
+        if (size.isValid() && decode < 1.0)
+            reader.setScaledSize(size * decode);
+        QImage source = reader.read();
+        ImageCropping t = member.transform;
+        if (!source.isNull() && size.isValid())
+            t.scaling *= size.width() / qreal(source.width());
+
+        // Virtual pixels are white and the light multiplies in linear light,
+        // as in the export.
+        QImage preview(previewSize, QImage::Format_RGB32);
+        preview.fill(Qt::white);
+        QPainter p(&preview);
+        p.setRenderHint(QPainter::SmoothPixmapTransform);
+        p.translate(previewSize.width() / 2.0, previewSize.height() / 2.0);
+        p.setWorldTransform(t.transform(scale), true);
+        p.drawImage(QPointF(-source.width() / 2.0, -source.height() / 2.0), source);
+        p.end();
+        LinearMultiply filter;
+        filter.setLight(light);
+        filter.apply(preview, preview.rect());
+        QMetaObject::invokeMethod(owner, "rendered", Qt::QueuedConnection,
+                                  Q_ARG(int, index), Q_ARG(QImage, preview));
+    }
+
+private:
+    GroupReview *owner;
+    int index;
+    GroupReview::Member member;
+    QSize outputSize;
+    QSize previewSize;
+    QColor light;
+};
+
+
+
+GroupReview::GroupReview(const QList<Member> &members, const QSize &outputSize,
+                         const QColor &light, QWidget *parent)
+    : QDialog(parent), members(members), included(members.count(), true),
+      outputSize(outputSize), previewSize(outputSize.scaled(previewBox, Qt::KeepAspectRatio)),
+      light(light), current(-1)
+{
+    setWindowTitle("Export Group");
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+
+    view = new QLabel(this);
+    view->setFixedSize(previewSize);
+    view->setAlignment(Qt::AlignCenter);
+    caption = new QLabel(this);
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Cancel, this);
+    exportButton = buttons->addButton("Export", QDialogButtonBox::AcceptRole);
+    exportButton->setDefault(true);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(view);
+    layout->addWidget(caption);
+    layout->addWidget(buttons);
+    showMember(0);
+}
+
+GroupReview::~GroupReview()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+QList<GroupReview::Member> GroupReview::accepted() const
+{
+    QList<Member> r;
+    for (int i = 0; i < members.count(); i++)
+        if (included.at(i))
+            r << members.at(i);
+    return r;
+}
+
+void GroupReview::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Left:
+        showMember(current - 1);
+        break;
+    case Qt::Key_Right:
+        showMember(current + 1);
+        break;
+    case Qt::Key_Space:
+        if (current >= 0) {
+            included[current] = !included.at(current);
+            updateCaption();
+        }
+        break;
+    default:
+        QDialog::keyPressEvent(event);
+    }
+}
+
+void GroupReview::rendered(int index, QImage image)
+{
+    rendering.remove(index);
+    if (index < current - renderBehind || index > current + renderAhead)
+        return;
+    previews.insert(index, image);
+    if (index == current)
+        view->setPixmap(QPixmap::fromImage(image));
+}
+
+void GroupReview::showMember(int index)
+{
+    if (index < 0 || index >= members.count())
+        return;
+    current = index;
+    if (previews.contains(index))
+        view->setPixmap(QPixmap::fromImage(previews.value(index)));
+    else
+        view->setText("Rendering...");
+    updateCaption();
+
+    for (int key : previews.keys())
+        if (key < current - renderBehind || key > current + renderAhead)
+            previews.remove(key);
+    for (int i = qMax(0, current - renderBehind);
+         i <= qMin(members.count() - 1, current + renderAhead); i++) {
+        if (previews.contains(i) || rendering.contains(i))
+            continue;
+        rendering.insert(i);
+        pool.start(new ReviewTask(this, i, members.at(i), outputSize,
+                                  previewSize, light),
+                   i == current ? 1 : 0);
+    }
+}
+
+void GroupReview::updateCaption()
+{
+    int count = accepted().count();
+    caption->setText(QString("%1 of %2: %3%4")
+                     .arg(current + 1).arg(members.count())
+                     .arg(QFileInfo(members.at(current).filename).fileName())
+                     .arg(included.at(current) ? "" : " (left out)"));
+    exportButton->setText(QString("Export %1").arg(count));
+    exportButton->setEnabled(count > 0);
+}
@@ -0,0 +1,57 @@
+#ifndef GROUPREVIEW_H
+#define GROUPREVIEW_H
+
+#include <QColor>
+#include <QDialog>
+#include <QHash>
+#include <QImage>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+#include "imagewindow.h"
+
+class QLabel;
+class QPushButton;
+
+// A quick look at every member of a group through the framing chosen for the
+// first, before any of them is exported.  Left and Right flip, Space leaves a
+// member out or puts it back, and Return exports the rest.  Previews are
+// rendered a few ahead on a thread pool from downscaled decodes.
+class GroupReview : public QDialog {
+    Q_OBJECT
+public:
+    struct Member {
+        QString filename;
+        ImageCropping transform;
+    };
+
+    GroupReview(const QList<Member> &members, const QSize &outputSize,
+                const QColor &light, QWidget *parent = 0);
+    ~GroupReview();
+    QList<Member> accepted() const;
+
+protected:
+    void keyPressEvent(QKeyEvent *event);
+
+private slots:
+    void rendered(int index, QImage image);
+
+private:
+    void showMember(int index);
+    void updateCaption();
+
+    QList<Member> members;
+    QVector<bool> included;
+    QHash<int, QImage> previews;
+    QSet<int> rendering;
+    QSize outputSize;
+    QSize previewSize;
+    QColor light;
+    int current;
+    QLabel *view;
+    QLabel *caption;
+    QPushButton *exportButton;
+    QThreadPool pool;
+};
+
+#endif // GROUPREVIEW_H
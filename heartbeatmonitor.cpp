@@ -0,0 +1,30 @@
+#include <QFile>
+#include "heartbeatmonitor.h"
+
+bool HeartbeatMonitor::isAlive(const QString &filename, int maxAgeSecs)
+{
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly)) {
+        forget(filename);
+        return false;
+    }
+    return isChanging(filename, f.readAll(), maxAgeSecs);
+}
+
+bool HeartbeatMonitor::isChanging(const QString &key, const QByteArray &beat,
+                                  int maxAgeSecs)
+{
+    auto it = sightings.find(key);
+    if (it == sightings.end() || it->beat != beat) {
+        Sighting &s = sightings[key];
+        s.beat = beat;
+        s.changed.start();
+        return true;
+    }
+    return it->changed.elapsed() < qint64(maxAgeSecs) * 1000;
+}
+
+void HeartbeatMonitor::forget(const QString &key)
+{
+    sightings.remove(key);
+}
@@ -0,0 +1,31 @@
+#ifndef HEARTBEATMONITOR_H
+#define HEARTBEATMONITOR_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+// Tells live writers of heartbeat files from dead ones without trusting any
+// clock but this process's own.  Hosts sharing a folder seldom agree on the
+// time, and a file's mtime on a share comes from the server or the writing
+// client, so neither can be compared with the local time.  Instead a heartbeat
+// is alive for as long as its content keeps changing, as timed here; one seen
+// for the first time is given the benefit of the doubt for a full window.
+class HeartbeatMonitor {
+public:
+    bool isAlive(const QString &filename, int maxAgeSecs);
+    // The same for anything else that should change, or go away, in time.
+    bool isChanging(const QString &key, const QByteArray &beat, int maxAgeSecs);
+    void forget(const QString &key);
+
+private:
+    struct Sighting {
+        QByteArray beat;
+        QElapsedTimer changed;
+    };
+
+    QHash<QString, Sighting> sightings;
+};
+
+#endif // HEARTBEATMONITOR_H
@@ -0,0 +1,44 @@
+#include "imagecropping.h"
+
+ImageCropping::ImageCropping()
+    : scaling(1), rotation(0), translation(0,0) {}
+
+#ifdef QT_GUI_LIB
+ImageCropping ImageCropping::fromImage(const QImage &image)
+{
+    return fromSize(image.size());
+}
+#endif
+
+ImageCropping ImageCropping::fromSize(const QSize &size)
+{
+    ImageCropping ic;
+    int w = size.width();
+    int h = size.height();
+    ic.scaling = 1;
+    ic.translation = QPointF(w&1 ? 0.5f : 0, h&1 ? 0.5f : 0);
+    ic.rotation = 0;
+    return ic;
+}
+
+void ImageCropping::sourceScaledBy(int powerOf2)
+{
+    scaling /= 1<<powerOf2;
+}
+
+#ifdef QT_GUI_LIB
+QTransform ImageCropping::transform(qreal initialScaling)
+{
+    QTransform m;
+    m.translate(translation.x()*initialScaling, translation.y()*initialScaling);
+    m.rotate(rotation);
+    m.scale(scaling * initialScaling, scaling * initialScaling);
+    return m;
+}
+#endif
+
+QString ImageCropping::toDisplayString()
+{
+    return QString("%1%, %2˚, (%3,%4)")
+            .arg(scaling*100).arg(rotation).arg(translation.x()).arg(translation.y());
+}
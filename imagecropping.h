@@ -0,0 +1,34 @@
+#ifndef IMAGECROPPING_H
+#define IMAGECROPPING_H
+
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#ifdef QT_GUI_LIB
+#include <QImage>
+#include <QTransform>
+#endif
+
+// How an image is framed: scaled and turned about its middle, then moved, in
+// output pixels.  The export worker builds against QtCore alone, so the parts
+// that need QtGui are left out there.
+class ImageCropping {
+public:
+    ImageCropping();
+#ifdef QT_GUI_LIB
+    static ImageCropping fromImage(const QImage &image);
+#endif
+    static ImageCropping fromSize(const QSize &size);
+    void sourceScaledBy(int powerOf2);
+#ifdef QT_GUI_LIB
+    QTransform transform(qreal initialScaling = 1.0);
+#endif
+    QString toDisplayString();
+
+    QSize image;
+    qreal scaling;
+    qreal rotation;
+    QPointF translation;
+};
+
+#endif // IMAGECROPPING_H
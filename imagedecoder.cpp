@@ -0,0 +1,440 @@
+#include <climits>
+#include <cstring>
+#include <QFile>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QVector>
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+#ifdef HAVE_SPNG
+#include <spng.h>
+#endif
+#ifdef HAVE_WEBP
+#include <webp/decode.h>
+#endif
+#include "imagedecoder.h"
+
+// Below this many pixels a JPEG is not worth splitting between cores.
+static const qint64 parallelPixels = 4000000;
+
+QImage ImageDecoder::read(const QString &filename, int threads)
+{
+    QImage image;
+    if (!readFast(filename, &image, threads))
+        image = QImageReader(filename).read();
+    return image;
+}
+
+bool ImageDecoder::readFast(const QString &filename, QImage *image, int threads)
+{
+    QFile file(filename);
+    if (!file.open(QFile::ReadOnly) || file.size() < 16)
+        return false;
+    const uchar *data = file.map(0, file.size());
+    if (!data)
+        return false;
+    qint64 size = file.size();
+    bool ok = false;
+    if (data[0] == 0xFF && data[1] == 0xD8)
+        ok = readJpeg(data, size, image, threads);
+    else if (!std::memcmp(data, "\x89PNG\r\n\x1a\n", 8))
+        ok = readPng(data, size, image);
+    else if (!std::memcmp(data, "RIFF", 4) && !std::memcmp(data + 8, "WEBP", 4))
+        ok = readWebp(data, size, image, threads);
+    file.unmap(const_cast<uchar*>(data));
+    if (!ok)
+        *image = QImage();
+    return ok;
+}
+
+QStringList ImageDecoder::backends()
+{
+    QStringList list;
+#ifdef HAVE_TURBOJPEG
+    list << "libjpeg-turbo";
+#endif
+#ifdef HAVE_SPNG
+    list << "libspng";
+#endif
+#ifdef HAVE_WEBP
+    list << "libwebp";
+#endif
+    return list;
+}
+
+
+
+#ifdef HAVE_TURBOJPEG
+
+// Where the parts of a baseline JPEG are, for decoding it a band at a time.
+// The entropy coded data restarts at every RST marker, so the data between
+// two of them that begin rows of MCUs decodes on its own, given the headers.
+struct JpegLayout {
+    int width;
+    int height;
+    int mcuWidth;
+    int mcuHeight;
+    int restartInterval;
+    int heightOffset;       // of the frame height, in the SOF segment
+    int headerEnd;          // just past the SOS segment
+    QVector<int> segments;  // where each restart interval's data begins
+    int dataEnd;            // the EOI marker
+};
+
+static bool parseJpeg(const uchar *d, int n, JpegLayout *l)
+{
+    int pos = 2;
+    int components = 0;
+    int hmax = 1, vmax = 1;
+    l->restartInterval = 0;
+    for (;;) {
+        if (pos + 4 > n || d[pos] != 0xFF)
+            return false;
+        uchar marker = d[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        int length = d[pos + 2] << 8 | d[pos + 3];
+        const uchar *s = d + pos + 4;
+        if (length < 2 || pos + 2 + length > n)
+            return false;
+        if (marker == 0xC0 || marker == 0xC1) {
+            if (length < 8)
+                return false;
+            l->heightOffset = pos + 5;
+            l->height = s[1] << 8 | s[2];
+            l->width = s[3] << 8 | s[4];
+            components = s[5];
+            if (length < 8 + 3 * components)
+                return false;
+            for (int c = 0; c < components; c++) {
+                hmax = qMax(hmax, s[7 + 3 * c] >> 4);
+                vmax = qMax(vmax, s[7 + 3 * c] & 15);
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF
+                   && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            // Progressive, lossless or arithmetic coded.
+            return false;
+        } else if (marker == 0xDD) {
+            l->restartInterval = s[0] << 8 | s[1];
+        } else if (marker == 0xDA) {
+            // One scan holding every component, or nothing to split.
+            if (!components || s[0] != components)
+                return false;
+            l->headerEnd = pos + 2 + length;
+            break;
+        }
+        pos += 2 + length;
+    }
+    if (!l->restartInterval || !l->width || !l->height)
+        return false;
+    l->mcuWidth = components == 1 ? 8 : hmax * 8;
+    l->mcuHeight = components == 1 ? 8 : vmax * 8;
+
+    l->segments.clear();
+    l->segments << l->headerEnd;
+    const uchar *p = d + l->headerEnd;
+    const uchar *end = d + n - 1;
+    while (p < end) {
+        p = static_cast<const uchar*>(std::memchr(p, 0xFF, end - p));
+        if (!p)
+            return false;
+        uchar m = p[1];
+        if (m == 0x00 || m == 0xFF) {
+            p++;
+        } else if (m >= 0xD0 && m <= 0xD7) {
+            l->segments << int(p - d) + 2;
+            p += 2;
+        } else {
+            l->dataEnd = int(p - d);
+            return m == 0xD9;
+        }
+    }
+    return false;
+}
+
+static bool decodeJpeg(const uchar *data, unsigned long size, uchar *pixels,
+                       int width, int pitch, int height, int format)
+{
+    tjhandle handle = tjInitDecompress();
+    if (!handle)
+        return false;
+    // Warnings, such as a few bytes missing at the end, still give a picture.
+    bool ok = tjDecompress2(handle, data, size, pixels, width, pitch, height,
+                            format, 0) == 0
+            || tjGetErrorCode(handle) == TJERR_WARNING;
+    tjDestroy(handle);
+    return ok;
+}
+
+class JpegBandTask : public QRunnable {
+public:
+    JpegBandTask(const uchar *data, const JpegLayout &layout,
+                 const QVector<int> &rows, const QVector<int> &segments,
+                 int first, int last, uchar *bits, int bytesPerLine,
+                 int bytesPerPixel, int format, QAtomicInt *failed,
+                 QSemaphore *done)
+        : data(data), layout(layout), rows(rows), segments(segments),
+          first(first), last(last), bits(bits), bytesPerLine(bytesPerLine),
+          bytesPerPixel(bytesPerPixel), format(format), failed(failed),
+          done(done) {}
+
+    void run()
+    {
+        if (!decode())
+            failed->store(1);
+        if (done)
+            done->release();
+    }
+
+    bool decode()
+    {
+        // Fancy chroma upsampling looks at the rows either side, so the band
+        // is decoded with a neighbour's rows around it and then trimmed.
+        int units = rows.count() - 1;
+        int from = qMax(0, first - 1);
+        int to = qMin(units, last + 1);
+        int top = rows.at(from) * layout.mcuHeight;
+        int bottom = qMin(layout.height, rows.at(to) * layout.mcuHeight);
+
+        int dataFrom = layout.segments.at(segments.at(from));
+        int dataTo = to == units ? layout.dataEnd
+                                 : layout.segments.at(segments.at(to)) - 2;
+        QByteArray band;
+        band.reserve(layout.headerEnd + dataTo - dataFrom + 2);
+        band.append(reinterpret_cast<const char*>(data), layout.headerEnd);
+        band[layout.heightOffset] = char((bottom - top) >> 8);
+        band[layout.heightOffset + 1] = char((bottom - top) & 255);
+        band.append(reinterpret_cast<const char*>(data) + dataFrom, dataTo - dataFrom);
+        // The decoder expects RST0 first and counts up from there.
+        uchar *p = reinterpret_cast<uchar*>(band.data()) + layout.headerEnd;
+        uchar *end = reinterpret_cast<uchar*>(band.data()) + band.size() - 1;
+        int next = 0;
+        for (; p < end; p++)
+            if (p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7)
+                p[1] = uchar(0xD0 + (next++ & 7));
+        band.append("\xFF\xD9", 2);
+
+        int pitch = layout.width * bytesPerPixel;
+        QByteArray pixels(pitch * (bottom - top), Qt::Uninitialized);
+        if (!decodeJpeg(reinterpret_cast<const uchar*>(band.constData()), band.size(),
+                        reinterpret_cast<uchar*>(pixels.data()),
+                        layout.width, pitch, bottom - top, format))
+            return false;
+        int ownTop = rows.at(first) * layout.mcuHeight;
+        int ownBottom = qMin(layout.height, rows.at(last) * layout.mcuHeight);
+        for (int y = ownTop; y < ownBottom; y++)
+            std::memcpy(bits + qint64(y) * bytesPerLine, pixels.constData() + (y - top) * pitch, pitch);
+        return true;
+    }
+
+private:
+    const uchar *data;
+    const JpegLayout &layout;
+    const QVector<int> &rows;
+    const QVector<int> &segments;
+    int first;
+    int last;
+    uchar *bits;
+    int bytesPerLine;
+    int bytesPerPixel;
+    int format;
+    QAtomicInt *failed;
+    QSemaphore *done;
+};
+
+// Apart from the global pool, which the prefetcher and friends may be using.
+Q_GLOBAL_STATIC(QThreadPool, bandPool)
+
+static bool decodeJpegBands(const uchar *data, qint64 size, QImage *image,
+                            int format, int threads)
+{
+    JpegLayout layout;
+    if (size > INT_MAX || !parseJpeg(data, int(size), &layout)
+            || layout.width != image->width() || layout.height != image->height())
+        return false;
+    int columns = (layout.width + layout.mcuWidth - 1) / layout.mcuWidth;
+    int mcuRows = (layout.height + layout.mcuHeight - 1) / layout.mcuHeight;
+    qint64 mcus = qint64(columns) * mcuRows;
+    if (layout.segments.count() != (mcus + layout.restartInterval - 1) / layout.restartInterval)
+        return false;
+
+    // The MCU rows that a restart interval begins, and which interval that is,
+    // ending with one past the last row.
+    QVector<int> rows, segments;
+    for (int s = 0; s < layout.segments.count(); s++) {
+        qint64 mcu = qint64(s) * layout.restartInterval;
+        if (mcu % columns == 0) {
+            rows << int(mcu / columns);
+            segments << s;
+        }
+    }
+    rows << mcuRows;
+    segments << layout.segments.count();
+    int units = rows.count() - 1;
+    int bands = qMin(threads, units);
+    if (bands < 2)
+        return false;
+
+    // The calling thread takes the first band itself.  The image is only
+    // written through bits, which must not detach from another thread.
+    uchar *bits = image->bits();
+    int bytesPerLine = image->bytesPerLine();
+    int bytesPerPixel = image->depth() / 8;
+    QAtomicInt failed(0);
+    QSemaphore done;
+    for (int b = 1; b < bands; b++) {
+        JpegBandTask *task = new JpegBandTask(data, layout, rows, segments,
+                                              b * units / bands, (b + 1) * units / bands,
+                                              bits, bytesPerLine, bytesPerPixel,
+                                              format, &failed, &done);
+        bandPool()->start(task);
+    }
+    JpegBandTask(data, layout, rows, segments, 0, units / bands,
+                 bits, bytesPerLine, bytesPerPixel, format, &failed, 0).run();
+    done.acquire(bands - 1);
+    return !failed.load();
+}
+
+#endif
+
+bool ImageDecoder::readJpeg(const uchar *data, qint64 size, QImage *image, int threads)
+{
+#ifdef HAVE_TURBOJPEG
+    tjhandle handle = tjInitDecompress();
+    if (!handle)
+        return false;
+    int width, height, subsampling, colorspace;
+    int header = tjDecompressHeader3(handle, data, size, &width, &height,
+                                     &subsampling, &colorspace);
+    tjDestroy(handle);
+    // CMYK wants Qt's inversion handling; leave it to the plugin.
+    if (header || colorspace == TJCS_CMYK || colorspace == TJCS_YCCK)
+        return false;
+
+    // Qt's own formats for JPEGs, so nothing changes for the painter.
+    bool gray = colorspace == TJCS_GRAY;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    int format = gray ? TJPF_GRAY : TJPF_BGRX;
+#else
+    int format = gray ? TJPF_GRAY : TJPF_XRGB;
+#endif
+    *image = QImage(width, height, gray ? QImage::Format_Grayscale8
+                                        : QImage::Format_RGB32);
+    if (image->isNull())
+        return false;
+    if (threads > 1 && qint64(width) * height >= parallelPixels
+            && decodeJpegBands(data, size, image, format, threads))
+        return true;
+    return decodeJpeg(data, size, image->bits(), width, image->bytesPerLine(),
+                      height, format);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(image);
+    Q_UNUSED(threads);
+    return false;
+#endif
+}
+
+bool ImageDecoder::readPng(const uchar *data, qint64 size, QImage *image)
+{
+#ifdef HAVE_SPNG
+    // PNG rows are filtered against the row above and inflated as one stream,
+    // so this runs on one core; libspng is simply quicker at it than libpng.
+    spng_ctx *ctx = spng_ctx_new(0);
+    if (!ctx)
+        return false;
+    bool ok = false;
+    struct spng_ihdr ihdr;
+    struct spng_trns trns;
+    spng_set_png_buffer(ctx, data, size);
+    if (spng_get_ihdr(ctx, &ihdr) == 0 && ihdr.interlace_method == SPNG_INTERLACE_NONE) {
+        bool alpha = ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA
+                || ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA
+                || spng_get_trns(ctx, &trns) == 0;
+        bool gray = ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE
+                && ihdr.bit_depth == 8 && !alpha;
+        int format = gray ? SPNG_FMT_G8 : alpha ? SPNG_FMT_RGBA8 : SPNG_FMT_RGB8;
+        size_t total = 0;
+        if (spng_decoded_image_size(ctx, format, &total) == 0
+                && spng_decode_image(ctx, NULL, 0, format,
+                                     SPNG_DECODE_PROGRESSIVE | SPNG_DECODE_TRNS) == 0) {
+            *image = QImage(ihdr.width, ihdr.height,
+                            gray ? QImage::Format_Grayscale8
+                                 : alpha ? QImage::Format_ARGB32_Premultiplied
+                                         : QImage::Format_RGB32);
+            size_t rowBytes = total / ihdr.height;
+            QByteArray row(gray ? 0 : int(rowBytes), Qt::Uninitialized);
+            ok = !image->isNull();
+            // Each row is converted while it is still in the cache, rather
+            // than converting the whole image afterwards.
+            for (int y = 0; ok && y < image->height(); y++) {
+                uchar *line = image->scanLine(y);
+                uchar *in = gray ? line : reinterpret_cast<uchar*>(row.data());
+                int r = spng_decode_row(ctx, in, rowBytes);
+                if (r != 0 && r != SPNG_EOI) {
+                    ok = false;
+                    break;
+                }
+                QRgb *out = reinterpret_cast<QRgb*>(line);
+                if (alpha) {
+                    for (int x = 0; x < image->width(); x++, in += 4)
+                        out[x] = qPremultiply(qRgba(in[0], in[1], in[2], in[3]));
+                } else if (!gray) {
+                    for (int x = 0; x < image->width(); x++, in += 3)
+                        out[x] = qRgb(in[0], in[1], in[2]);
+                }
+            }
+        }
+    }
+    spng_ctx_free(ctx);
+    return ok;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(image);
+    return false;
+#endif
+}
+
+bool ImageDecoder::readWebp(const uchar *data, qint64 size, QImage *image, int threads)
+{
+#ifdef HAVE_WEBP
+    WebPDecoderConfig config;
+    if (!WebPInitDecoderConfig(&config)
+            || WebPGetFeatures(data, size, &config.input) != VP8_STATUS_OK
+            || config.input.has_animation)
+        return false;
+    bool alpha = config.input.has_alpha;
+    *image = QImage(config.input.width, config.input.height,
+                    alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    if (image->isNull())
+        return false;
+
+    // Premultiplied straight from the decoder, in the byte order of a QRgb.
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    config.output.colorspace = alpha ? MODE_bgrA : MODE_BGRA;
+#else
+    config.output.colorspace = alpha ? MODE_Argb : MODE_ARGB;
+#endif
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = image->bits();
+    config.output.u.RGBA.stride = image->bytesPerLine();
+    config.output.u.RGBA.size = image->byteCount();
+    config.options.use_threads = threads > 1;
+    bool ok = WebPDecode(data, size, &config) == VP8_STATUS_OK;
+    WebPFreeDecBuffer(&config.output);
+    return ok;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(image);
+    Q_UNUSED(threads);
+    return false;
+#endif
+}
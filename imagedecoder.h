@@ -0,0 +1,25 @@
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <QImage>
+#include <QStringList>
+
+// Decodes JPEG, PNG and WebP sources with whichever of libjpeg-turbo, libspng
+// and libwebp the build found, straight into the formats QPainter draws
+// quickest.  Everything else, and anything those libraries turn down, goes to
+// Qt's plugins as before.
+class ImageDecoder {
+public:
+    // threads is how many cores one decode may use; JPEGs with restart
+    // markers and WebPs can make use of more than one.
+    static QImage read(const QString &filename, int threads = 1);
+    static bool readFast(const QString &filename, QImage *image, int threads = 1);
+    static QStringList backends();
+
+private:
+    static bool readJpeg(const uchar *data, qint64 size, QImage *image, int threads);
+    static bool readPng(const uchar *data, qint64 size, QImage *image);
+    static bool readWebp(const uchar *data, qint64 size, QImage *image, int threads);
+};
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,188 @@
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+#include "imageindex.h"
+
+static const quint32 indexMagic = 0x44434958;    // "DCIX"
+static const quint32 indexVersion = 1;
+static const int batchSize = 64;
+
+QSize ImageHeader::displaySize() const
+{
+    return orientation & QImageIOHandler::TransformationRotate90 ? size.transposed()
+                                                                 : size;
+}
+
+static QDataStream &operator<<(QDataStream &s, const ImageHeader &h)
+{
+    return s << h.filename << h.fileSize << h.modified << h.size << h.format
+             << qint32(h.depth) << qint32(h.orientation);
+}
+
+static QDataStream &operator>>(QDataStream &s, ImageHeader &h)
+{
+    qint32 depth, orientation;
+    s >> h.filename >> h.fileSize >> h.modified >> h.size >> h.format
+      >> depth >> orientation;
+    h.depth = depth;
+    h.orientation = orientation;
+    return s;
+}
+
+
+
+class ProbeTask : public QRunnable {
+public:
+    ProbeTask(ImageIndex *owner, const QStringList &filenames)
+        : owner(owner), filenames(filenames) {}
+
+    void run()
+    {
+        QVector<ImageHeader> results;
+        for (const QString &filename : filenames) {
+            QFileInfo info(filename);
+            ImageHeader h;
+            h.filename = filename;
+            h.fileSize = info.size();
+            h.modified = info.lastModified();
+            // Everything asked for here comes out of the header; nothing
+            // calls read().
+            QImageReader reader(filename);
+            h.size = reader.size();
+            h.format = reader.format();
+            h.depth = QImage::toPixelFormat(reader.imageFormat()).bitsPerPixel();
+            h.orientation = reader.transformation();
+            results << h;
+        }
+        QMetaObject::invokeMethod(owner, "batchProbed", Qt::QueuedConnection,
+                                  Q_ARG(QVector<ImageHeader>, results));
+    }
+
+private:
+    ImageIndex *owner;
+    QStringList filenames;
+};
+
+
+
+ImageIndex::ImageIndex(QObject *parent)
+    : QObject(parent), pending_(0), dirty(false)
+{
+    qRegisterMetaType<ImageHeader>();
+    qRegisterMetaType<QVector<ImageHeader>>();
+    // Header reads are mostly waiting on the disk, so oversubscribe a little.
+    pool.setMaxThreadCount(qMax(2, QThread::idealThreadCount()));
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(5000);
+    connect(&saveTimer, &QTimer::timeout, this, &ImageIndex::save);
+    load();
+}
+
+ImageIndex::~ImageIndex()
+{
+    pool.clear();
+    pool.waitForDone();
+    save();
+}
+
+void ImageIndex::probe(const QStringList &filenames)
+{
+    QStringList batch;
+    for (const QString &filename : filenames) {
+        auto it = headers.constFind(filename);
+        if (it != headers.constEnd() && isCurrent(*it, filename)) {
+            emit probed(*it);
+            continue;
+        }
+        batch << filename;
+        if (batch.count() == batchSize) {
+            pending_ += batch.count();
+            pool.start(new ProbeTask(this, batch));
+            batch.clear();
+        }
+    }
+    if (!batch.isEmpty()) {
+        pending_ += batch.count();
+        pool.start(new ProbeTask(this, batch));
+    }
+}
+
+bool ImageIndex::lookup(const QString &filename, ImageHeader *header) const
+{
+    auto it = headers.constFind(filename);
+    if (it == headers.constEnd())
+        return false;
+    *header = *it;
+    return true;
+}
+
+int ImageIndex::pending() const
+{
+    return pending_;
+}
+
+void ImageIndex::save()
+{
+    if (!dirty)
+        return;
+    QString filename = indexFilename();
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+    QSaveFile f(filename);
+    if (!f.open(QFile::WriteOnly))
+        return;
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_5_0);
+    s << indexMagic << indexVersion << quint32(headers.count());
+    for (const ImageHeader &h : headers)
+        s << h;
+    if (f.commit())
+        dirty = false;
+}
+
+void ImageIndex::batchProbed(QVector<ImageHeader> results)
+{
+    pending_ -= results.count();
+    for (const ImageHeader &h : results) {
+        headers.insert(h.filename, h);
+        emit probed(h);
+    }
+    dirty = true;
+    saveTimer.start();
+    if (pending_ == 0)
+        emit idle();
+}
+
+QString ImageIndex::indexFilename()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + "/imageindex.dat";
+}
+
+bool ImageIndex::isCurrent(const ImageHeader &cached, const QString &filename) const
+{
+    QFileInfo info(filename);
+    return info.size() == cached.fileSize && info.lastModified() == cached.modified;
+}
+
+void ImageIndex::load()
+{
+    QFile f(indexFilename());
+    if (!f.open(QFile::ReadOnly))
+        return;
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version, count;
+    s >> magic >> version >> count;
+    if (magic != indexMagic || version != indexVersion)
+        return;
+    for (quint32 i = 0; i < count && s.status() == QDataStream::Ok; i++) {
+        ImageHeader h;
+        s >> h;
+        headers.insert(h.filename, h);
+    }
+}
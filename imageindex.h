@@ -0,0 +1,64 @@
+#ifndef IMAGEINDEX_H
+#define IMAGEINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QSize>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
+
+// What the queue knows about a file without decoding it.  size is as stored;
+// displaySize() accounts for the EXIF orientation.
+struct ImageHeader {
+    QString filename;
+    qint64 fileSize;
+    QDateTime modified;
+    QSize size;
+    QByteArray format;
+    int depth;
+    int orientation;    // QImageIOHandler::Transformations
+
+    ImageHeader() : fileSize(0), depth(0), orientation(0) {}
+    bool isValid() const { return size.isValid(); }
+    QSize displaySize() const;
+};
+Q_DECLARE_METATYPE(ImageHeader)
+
+// Reads image headers on a thread pool and remembers them across runs, keyed
+// by path, modification time and file size, so that a large queue can be
+// sorted and filtered before anything is decoded.
+class ImageIndex : public QObject {
+    Q_OBJECT
+public:
+    ImageIndex(QObject *parent = 0);
+    ~ImageIndex();
+
+    void probe(const QStringList &filenames);
+    bool lookup(const QString &filename, ImageHeader *header) const;
+    int pending() const;
+    void save();
+
+signals:
+    void probed(ImageHeader header);
+    void idle();
+
+private slots:
+    void batchProbed(QVector<ImageHeader> headers);
+
+private:
+    static QString indexFilename();
+    bool isCurrent(const ImageHeader &cached, const QString &filename) const;
+    void load();
+
+    QThreadPool pool;
+    QHash<QString, ImageHeader> headers;
+    QTimer saveTimer;
+    int pending_;
+    bool dirty;
+};
+
+#endif // IMAGEINDEX_H
@@ -0,0 +1,98 @@
+#include <QImageReader>
+#include <QRunnable>
+#include <QThread>
+#include "imageprefetcher.h"
+#include "imagedecoder.h"
+#include "memorybudget.h"
+#include "tiledimage.h"
+
+class PrefetchTask : public QRunnable {
+public:
+    PrefetchTask(ImagePrefetcher *owner, const QString &filename,
+                 bool decode, qint64 maxBytes)
+        : owner(owner), filename(filename), decode(decode), maxBytes(maxBytes) {}
+
+    void run()
+    {
+        QImageReader reader(filename);
+        QSize size = reader.size();
+
+        QImage image;
+        qint64 bytes = qint64(size.width()) * size.height() * 4;
+        if (decode && size.isValid() && !TiledImage::wanted(size) && bytes <= maxBytes)
+            // One core each: the pool already decodes several files at once.
+            image = ImageDecoder::read(filename);
+        QMetaObject::invokeMethod(owner, "decoded", Qt::QueuedConnection,
+                                  Q_ARG(QString, filename), Q_ARG(QImage, image));
+    }
+
+private:
+    ImagePrefetcher *owner;
+    QString filename;
+    bool decode;
+    qint64 maxBytes;
+};
+
+
+
+ImagePrefetcher::ImagePrefetcher(QObject *parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+    pool.clear();
+    pool.waitForDone();
+    clear();
+}
+
+void ImagePrefetcher::prefetch(const QString &filename, bool decode)
+{
+    if (inFlight.contains(filename) || cache.contains(filename))
+        return;
+    inFlight.insert(filename);
+    qint64 maxBytes = MemoryBudget::instance()->available();
+    pool.start(new PrefetchTask(this, filename, decode, maxBytes));
+}
+
+bool ImagePrefetcher::take(const QString &filename, QImage *image)
+{
+    auto it = cache.find(filename);
+    if (it == cache.end())
+        return false;
+    *image = it->image;
+    drop(filename);
+    return true;
+}
+
+void ImagePrefetcher::clear()
+{
+    for (const QString &filename : cache.keys())
+        drop(filename);
+}
+
+void ImagePrefetcher::decoded(QString filename, QImage image)
+{
+    inFlight.remove(filename);
+    if (image.isNull())
+        return;
+    MemoryBudget *budget = MemoryBudget::instance();
+    Entry e;
+    e.image = image;
+    e.budgetId = budget->add("Prefetched " + filename, MemoryBudget::Speculative,
+                             [this, filename]() { drop(filename); });
+    cache.insert(filename, e);
+    budget->resize(e.budgetId, image.byteCount());
+}
+
+void ImagePrefetcher::drop(const QString &filename)
+{
+    auto it = cache.find(filename);
+    if (it == cache.end())
+        return;
+    int budgetId = it->budgetId;
+    cache.erase(it);
+    MemoryBudget::instance()->remove(budgetId);
+}
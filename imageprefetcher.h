@@ -0,0 +1,39 @@
+#ifndef IMAGEPREFETCHER_H
+#define IMAGEPREFETCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QImage>
+#include <QSet>
+#include <QThreadPool>
+
+// Decodes upcoming images on worker threads so that they are ready by the
+// time the cropper reaches them.  Decoded images are held as speculative
+// entries in the memory budget and are the first thing dropped under pressure.
+class ImagePrefetcher : public QObject {
+    Q_OBJECT
+public:
+    ImagePrefetcher(QObject *parent = 0);
+    ~ImagePrefetcher();
+
+    void prefetch(const QString &filename, bool decode = true);
+    bool take(const QString &filename, QImage *image);
+    void clear();
+
+private slots:
+    void decoded(QString filename, QImage image);
+
+private:
+    struct Entry {
+        QImage image;
+        int budgetId;
+    };
+
+    void drop(const QString &filename);
+
+    QThreadPool pool;
+    QSet<QString> inFlight;
+    QHash<QString, Entry> cache;
+};
+
+#endif // IMAGEPREFETCHER_H
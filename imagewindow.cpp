@@ -11,65 +11,68 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QStandardPaths>
-#include <QUuid>
 #include <QProcess>
 #include <QProcessEnvironment>
 #include <QCloseEvent>
+#include <QScreen>
+#include <QImageReader>
+#include <QWindow>
+#include <QThread>
 #include "imagewindow.h"
-
-
-ImageCropping::ImageCropping()
-    : scaling(1), rotation(0), translation(0,0) {}
-
-ImageCropping ImageCropping::fromImage(const QImage &image)
-{
-    ImageCropping ic;
-    int w = image.width();
-    int h = image.height();
-    ic.scaling = 1;
-    ic.translation = QPointF(w&1 ? 0.5f : 0, h&1 ? 0.5f : 0);
-    ic.rotation = 0;
-    return ic;
-}
-
-void ImageCropping::sourceScaledBy(int powerOf2)
-{
-    scaling /= 1<<powerOf2;
-}
-
-QTransform ImageCropping::transform(qreal initialScaling)
-{
-    QTransform m;
-    m.translate(translation.x()*initialScaling, translation.y()*initialScaling);
-    m.rotate(rotation);
-    m.scale(scaling * initialScaling, scaling * initialScaling);
-    return m;
-}
-
-QString ImageCropping::toDisplayString()
-{
-    return QString("%1%, %2˚, (%3,%4)")
-            .arg(scaling*100).arg(rotation).arg(translation.x()).arg(translation.y());
-}
-
-
+#include "memorybudget.h"
+#include "scratchmanager.h"
+#include "filmstrip.h"
+#include "imageprefetcher.h"
+#include "imagedecoder.h"
+#include "deferredexport.h"
+#include "processgovernor.h"
+#include "stallwatchdog.h"
+
+// Room left around the framed part when only that is doubled, as a fraction
+// of the framing's larger side, so that it can still be nudged about.
+static const qreal regionMargin = 0.25;
+// Beyond this fraction of the image, doubling a region saves too little.
+static const qreal regionLimit = 0.6;
 
 ImageWindow::ImageWindow(QWidget *parent)
     : QWidget(parent),
       done(true),
       displayScale(1.0),
       background(64, 64, QImage::Format_RGB32),
+      prefetcher(NULL),
       processor(-1),
       noise(NoNoise),
+      regionDoubling(false),
+      regionDoublings(0),
+      fullDoublingsPending(0),
       multiplying(false),
       rulesShown(false),
+      glWidth(0),
+      glHeight(0),
+      mouseCause(Qt::NoButton),
       opacity(0),
+      opacityTime(0),
       doubler(NULL)
 {
     setWindowTitle("Dark Cropper Manipulation");
     setWindowIcon(QIcon(":/images/logo-48x48.png"));
     setupBackground();
     setupActions();
+    filmstrip = new Filmstrip(this);
+    filmstrip->setAttribute(Qt::WA_TransparentForMouseEvents);
+    connect(&scheduler, &FrameScheduler::frame,
+            this, &ImageWindow::scheduler_frame);
+    MemoryBudget *budget = MemoryBudget::instance();
+    sourceBudget = budget->add("Current image", MemoryBudget::Current);
+    layerBudget = budget->add("Multiply layer", MemoryBudget::Working, [this]() {
+        multiplyLayer = QImage();
+    });
+    workingCopyBudget = budget->add("Doubled working copy", MemoryBudget::Current);
+    connect(&tiledSource, &TiledImage::ready,
+            &scheduler, &FrameScheduler::requestFrame);
+    connect(&tiledSource, &TiledImage::failed, this, [this]() {
+        showMessage("Could not decode this image.");
+    });
     setExecutable();
     setModelDir();
 }
@@ -79,13 +82,25 @@ ImageWindow::~ImageWindow()
     stop();
     cleanupActions();
     removeWorkingCopy();
+    MemoryBudget *budget = MemoryBudget::instance();
+    budget->remove(sourceBudget);
+    budget->remove(layerBudget);
+    budget->remove(workingCopyBudget);
 }
 
 ImageCropping ImageWindow::getTransform()
 {
+    applyPendingInput();
     return transform;
 }
 
+void ImageWindow::setTransform(const ImageCropping &transform)
+{
+    mouseDelta = QPointF();
+    this->transform = transform;
+    scheduler.requestFrame();
+}
+
 void ImageWindow::setDisplayScale(qreal factor)
 {
     displayScale = factor / devicePixelRatio();
@@ -137,13 +152,43 @@ void ImageWindow::setProcessor(int index)
     processor = index;
 }
 
+void ImageWindow::setRegionDoubling(bool enabled)
+{
+    regionDoubling = enabled;
+}
+
 void ImageWindow::setEmulatedSize(QSize size)
 {
-    emulatedSize_ = size / displayScale;
+    emulatedSize_ = size;
+}
+
+// The size a window of this many device-independent pixels stands for when
+// drawn at the given scale, as setDisplayScale() takes it.
+QSize ImageWindow::emulatedSizeFor(QSize window, qreal scale)
+{
+    return window / (scale / devicePixelRatio());
+}
+
+void ImageWindow::setLightColor(const QColor &color)
+{
+    lightFilter.setLight(color);
+    if (multiplying)
+        scheduler.requestFrame();
+}
+
+void ImageWindow::setFrameRateCap(int fps)
+{
+    scheduler.setRateCap(fps);
+}
+
+void ImageWindow::setPrefetcher(ImagePrefetcher *prefetcher)
+{
+    this->prefetcher = prefetcher;
 }
 
 QStringList ImageWindow::processors()
 {
+    StallWatchdog::Scope stall("ImageWindow::processors");
     QProcess p;
     p.setProgram(executable);
     p.setArguments({"--list-processor"});
@@ -160,6 +205,16 @@ QStringList ImageWindow::processors()
     return out;
 }
 
+QString ImageWindow::executablePath()
+{
+    return executable;
+}
+
+QString ImageWindow::modelDir()
+{
+    return modelFolder;
+}
+
 QSize ImageWindow::emulatedSize()
 {
     return emulatedSize_;
@@ -170,12 +225,32 @@ bool ImageWindow::isDone()
     return done;
 }
 
+bool ImageWindow::isDoubling()
+{
+    return doubler != NULL;
+}
+
+QString ImageWindow::workingProvenance()
+{
+    return provenance;
+}
+
+void ImageWindow::exportCurrent()
+{
+    actionExport_triggered();
+}
+
 void ImageWindow::stop()
 {
+    fullDoublingsPending = 0;
     if (doubler) {
         doubler->terminate();
         doubler->deleteLater();
         doubler = NULL;
+        ScratchManager::instance()->release(doubledFilename);
+        if (!croppedFilename.isEmpty())
+            ScratchManager::instance()->release(croppedFilename);
+        croppedFilename.clear();
     }
 }
 
@@ -184,6 +259,11 @@ void ImageWindow::setExportShortcut(const QKeySequence &shortcut)
     actionExport->setShortcut(shortcut);
 }
 
+void ImageWindow::setExportGroupShortcut(const QKeySequence &shortcut)
+{
+    actionExportGroup->setShortcut(shortcut);
+}
+
 void ImageWindow::setEscapeShortcut(const QKeySequence &shortcut)
 {
     actionEscape->setShortcut(shortcut);
@@ -239,55 +319,73 @@ void ImageWindow::setShowRulesShortcut(const QKeySequence &shortcut)
     actionShowRules->setShortcut(shortcut);
 }
 
+void ImageWindow::setShowFilmstripShortcut(const QKeySequence &shortcut)
+{
+    actionShowFilmstrip->setShortcut(shortcut);
+}
+
+void ImageWindow::setFilmstrip(const QStringList &previous, const QString &current,
+                               const QStringList &next)
+{
+    filmstrip->setFiles(previous, current, next);
+}
+
 void ImageWindow::setSource(const QString &filename)
 {
+    StallWatchdog::Scope stall("ImageWindow::setSource");
+    sourceTimer.start();
     done = false;
-    source.load(filename);
+    loadSource(filename);
     sourceFilename = workingFilename = filename;
-    transform = ImageCropping::fromImage(source);
+    provenance.clear();
+    regionBaseFilename.clear();
+    regionDoublings = 0;
+    MemoryBudget::instance()->resize(workingCopyBudget, 0);
+    transform = ImageCropping::fromSize(sourceSize());
     noise = NoNoise;
     updateFields();
     calculateDrawPoint();
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::setScaledSource(const QString &filename, int powerOf2)
 {
-    source.load(filename);
+    StallWatchdog::Scope stall("ImageWindow::setScaledSource");
+    loadSource(filename);
     transform.sourceScaledBy(powerOf2);
     calculateDrawPoint();
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::showMessage(const QString &message)
 {
     opacity = 2.5;
+    opacityTime = scheduler.now();
     this->message = message;
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::paintEvent(QPaintEvent *ev)
 {
+    StallWatchdog::Scope stall("ImageWindow::paintEvent");
      (void)ev;
+    QElapsedTimer frameTimer;
+    frameTimer.start();
     QPainter p;
     p.begin(this);
-
-    QBrush fillBrush;
-    fillBrush.setTextureImage(background);
-    p.fillRect(QRect(0, 0, glWidth+1, glHeight+1), fillBrush);
+    paintBackground(p);
 
     QRect windowRect = QRect(-glWidth/2.0, -glHeight/2.0,
                              glWidth, glHeight);
     p.setWindow(windowRect);
-    if (!source.isNull()) {
+    if (hasSource() && multiplying) {
+        paintMultiplied(p, windowRect);
+    } else if (hasSource()) {
         QTransform oldTransform = p.transform();
         p.setWorldTransform(transform.transform(displayScale));
-        p.setCompositionMode(multiplying ? QPainter::CompositionMode_Multiply
-                                         : QPainter::CompositionMode_SourceOver);
         p.setRenderHint(QPainter::SmoothPixmapTransform);
-        p.drawImage(drawPoint, source);
+        drawSource(p);
         p.setTransform(oldTransform);
-        p.setCompositionMode(QPainter::CompositionMode_SourceOver);
     }
 
     p.setWindow(QRect(0, 0, glWidth, glHeight));
@@ -312,11 +410,8 @@ void ImageWindow::paintEvent(QPaintEvent *ev)
     };
 
 
-    if (!message.isEmpty() && opacity > 0.001) {
-        opacity -= 0.05;
+    if (!message.isEmpty() && opacity > 0.001)
         drawMessage(opacity, 30, 1.0, 1.0, message);
-        QTimer::singleShot(100, this, SLOT(update()));
-    }
     drawMessage(1.0, 15, 0.0, 0.0, transform.toDisplayString());
     drawMessage(1.0, 15, 0.5, 0.0, fileField);
     drawMessage(1.0, 15, 0.0, 1.0, noiseField);
@@ -355,13 +450,24 @@ void ImageWindow::paintEvent(QPaintEvent *ev)
         p.drawPath(path);
     }
     p.end();
+
+    emit framePainted(frameTimer.nsecsElapsed());
+    if (sourceTimer.isValid()) {
+        emit firstFramePainted(sourceFilename, sourceTimer.nsecsElapsed());
+        sourceTimer.invalidate();
+    }
 }
 
 void ImageWindow::resizeEvent(QResizeEvent *ev)
 {
     glWidth = (ev->size().width() & ~1);
     glHeight = (ev->size().height() & ~1);
+    if (windowHandle() && windowHandle()->screen())
+        scheduler.setRefreshRate(windowHandle()->screen()->refreshRate());
     calculateDrawPoint();
+    // Above the noise and message fields along the bottom edge.
+    int stripHeight = filmstrip->sizeHint().height();
+    filmstrip->setGeometry(0, height() - stripHeight - 60, width(), stripHeight);
 }
 
 void ImageWindow::closeEvent(QCloseEvent *event)
@@ -372,38 +478,76 @@ void ImageWindow::closeEvent(QCloseEvent *event)
 
 void ImageWindow::mousePressEvent(QMouseEvent *event)
 {
-    mouseTransform = transform;
+    applyPendingInput();
+    ProcessGovernor::instance()->interacted();
     mouseLast = event->localPos();
     mouseCause = event->button();
 }
 
 void ImageWindow::mouseMoveEvent(QMouseEvent *event)
 {
+    // Only accumulate here; the scheduler applies the sum once per frame.
+    ProcessGovernor::instance()->interacted();
     float ts = (event->modifiers() & Qt::ShiftModifier) ? 0.25 : 1;
-    if (mouseCause == Qt::MiddleButton) {
-        // FIXME: move along angles when ctrl is pressed
-        transform.scaling = mouseTransform.scaling + ts*(mouseLast.y() - event->localPos().y())/100;
-    } else if (mouseCause == Qt::LeftButton) {
-        transform.translation = mouseTransform.translation + ts*(event->localPos() - mouseLast)/displayScale;
-    } else if (mouseCause == Qt::RightButton) {
-        // FIXME: rotate around point of click
-        if (std::abs(transform.scaling) > 0.0001 )
-            transform.rotation = mouseTransform.rotation + ts*(event->localPos().x() - mouseLast.x())/transform.scaling;
-    }
+    mouseDelta += ts*(event->localPos() - mouseLast);
     mouseLast = event->localPos();
-    mouseTransform = transform;
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionExport_triggered()
 {
+    StallWatchdog::Scope stall("ImageWindow::actionExport_triggered");
+    applyPendingInput();
+    // A framing that has left the doubled region goes back to the base.  The
+    // whole-image doubling that starts must not be stopped: it is handed to a
+    // DeferredExport below like any doubling still running at export.
+    if (!regionBaseFilename.isEmpty() && !regionCovers())
+        revertRegion();
     done = true;
+    // The export takes the working copy; nothing else will need the base.
+    dropRegionBase();
+    // The export needs the working copy's size to read only what it shows.
+    ImageCropping framing = transform;
+    framing.image = sourceSize();
     if (doubler) {
-        doubler->terminate();
-        doubler->deleteLater();
+        // The doubling carries on without the cropper and the export follows
+        // it, rather than throwing away what waifu2x has done so far.
+        DeferredExport::Doubling d;
+        d.sourceFilename = sourceFilename;
+        d.inputFilename = workingFilename;
+        d.inputSize = sourceSize();
+        d.croppedFilename = croppedFilename;
+        d.region = doublingRegion;
+        d.outputFilename = doubledFilename;
+        d.repeats = fullDoublingsPending;
+        d.provenance = provenance;
+        d.doublingProvenance = doublingProvenance;
+        d.framing = framing;
+        d.frame = emulatedSize_;
+        doubler->disconnect(this);
+        DeferredExport *pending = new DeferredExport(doubler, d, this);
         doubler = NULL;
+        croppedFilename.clear();
+        fullDoublingsPending = 0;
+        emit exportAfterDoubling(pending);
+        return;
     }
-    emit exportFile(sourceFilename, workingFilename, transform);
+    emit exportFile(sourceFilename, workingFilename, framing);
+}
+
+void ImageWindow::actionExportGroup_triggered()
+{
+    StallWatchdog::Scope stall("ImageWindow::actionExportGroup_triggered");
+    // Nothing is final until the group has been reviewed; exportCurrent()
+    // finishes the job if it is accepted.
+    applyPendingInput();
+    if (!hasSource() || done)
+        return;
+    // Members are framed like the whole image, not the doubled part of it.
+    if (!regionBaseFilename.isEmpty())
+        emit exportGroup(sourceFilename, regionBaseSize, regionBaseTransform());
+    else
+        emit exportGroup(sourceFilename, sourceSize(), transform);
 }
 
 void ImageWindow::actionEscape_triggered()
@@ -415,6 +559,7 @@ void ImageWindow::actionEscape_triggered()
 
 void ImageWindow::actionSkip_triggered()
 {
+    StallWatchdog::Scope stall("ImageWindow::actionSkip_triggered");
     done = true;
     removeWorkingCopy();
     emit skip();
@@ -430,25 +575,78 @@ void ImageWindow::actionDouble_triggered()
         showMessage("waifu2x not configured");
         return;
     }
-    showMessage("Doubling in progress. Please wait.");
+    startDoubling(!regionDoubling);
+}
+
+void ImageWindow::startDoubling(bool wholeImage)
+{
+    StallWatchdog::Scope stall("ImageWindow::startDoubling");
+    // Only the framed part and a margin around it, when that is much less
+    // than the whole; waifu2x takes time in proportion to the pixels.
+    doublingRegion = QRect();
+    if (!wholeImage && hasSource()) {
+        QSize size = sourceSize();
+        QRectF framed = framedRegion();
+        qreal margin = regionMargin * qMax(framed.width(), framed.height());
+        QRect region = framed.adjusted(-margin, -margin, margin, margin)
+                .toAlignedRect() & QRect(QPoint(0, 0), size);
+        if (!region.isEmpty() && qint64(region.width()) * region.height()
+                < regionLimit * size.width() * size.height())
+            doublingRegion = region;
+    }
 
-    doubledFilename = QString("/dev/shm/darkcropper-%1.%2")
-            .arg(QUuid::createUuid().toString())
-            .arg(QFileInfo(workingFilename).suffix());
+    QString input = workingFilename;
+    if (doublingRegion.isValid()) {
+        // A tiled source is cut from its mapped pixels; the image readers
+        // would decode most or all of the file to get at the region.  Until
+        // the mapping is there, the whole image is doubled.
+        QImage crop;
+        if (!source.isNull())
+            crop = source.copy(doublingRegion);
+        else if (tiledSource.isReady())
+            crop = tiledSource.region(doublingRegion);
+        croppedFilename = ScratchManager::instance()->allocate(
+                    "png", qint64(crop.width()) * crop.height() * 4);
+        // Hardly compressed: it is read once, straight away.
+        if (crop.isNull() || !crop.save(croppedFilename, "PNG", 90)) {
+            ScratchManager::instance()->release(croppedFilename);
+            croppedFilename.clear();
+            doublingRegion = QRect();
+        } else {
+            ScratchManager::instance()->update(croppedFilename);
+            input = croppedFilename;
+        }
+    }
+    showMessage(doublingRegion.isValid()
+                ? "Doubling the framed region. Please wait."
+                : "Doubling in progress. Please wait.");
 
-    doubler = new QProcess();
+    // Doubling quadruples the pixel count, and the file roughly with it.
+    doubledFilename = ScratchManager::instance()->allocate(
+                QFileInfo(input).suffix(),
+                QFileInfo(input).size() * 4);
+
+    doubler = ProcessGovernor::instance()->create();
     QString model = noise != NoNoise ? "noise-scale" : "scale";
     QStringList args = {
         "--scale-ratio", "2.000",
         "-m", model,
         "--model-dir", modelFolder,
-        "-i", workingFilename,
+        "-i", input,
         "-o", doubledFilename
     };
     if (noise != NoNoise)
         args << "--noise-level" << QString::number((int)noise);
     if (processor >= 0)
         args << "--processor" << QString::number(processor);
+    args << "--jobs" << QString::number(ProcessGovernor::instance()->threadLimit());
+    doublingProvenance = QString("waifu2x %1 noise=%2 models=%3;")
+            .arg(model).arg((int)noise).arg(QFileInfo(modelFolder).fileName());
+    if (doublingRegion.isValid())
+        doublingProvenance.insert(doublingProvenance.count() - 1,
+                                  QString(" region=%1x%2+%3+%4")
+                                  .arg(doublingRegion.width()).arg(doublingRegion.height())
+                                  .arg(doublingRegion.x()).arg(doublingRegion.y()));
     doubler->setArguments(args);
     doubler->setProgram(executable);
     qDebug() << executable << args;
@@ -464,73 +662,147 @@ void ImageWindow::actionNoise_triggered()
         nextNoise.insert(2, ExcessiveNoise);
     noise = nextNoise.at(noise);
     updateFields();
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionMultiply_triggered()
 {
     multiplying ^= true;
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionWidth_triggered()
 {
-    if (source.isNull())
+    applyPendingInput();
+    if (!hasSource())
         return;
-    transform.scaling = emulatedSize_.width() / (double)source.width();
-    update();
+    transform.scaling = emulatedSize_.width() / (double)sourceSize().width();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionHeight_triggered()
 {
-    if (source.isNull())
+    applyPendingInput();
+    if (!hasSource())
         return;
-    transform.scaling = emulatedSize_.height() / (double)source.height();
-    update();
+    transform.scaling = emulatedSize_.height() / (double)sourceSize().height();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionResetZoom_triggered()
 {
+    applyPendingInput();
     transform.scaling = 1.0;
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionResetRotation_triggered()
 {
+    applyPendingInput();
     transform.rotation = 0.0;
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionResetLocation_triggered()
 {
+    applyPendingInput();
     transform.translation = {0,0};
-    update();
+    scheduler.requestFrame();
 }
 
 void ImageWindow::actionShowRules_triggered()
 {
     rulesShown ^= true;
-    update();
+    scheduler.requestFrame();
+}
+
+void ImageWindow::actionShowFilmstrip_triggered()
+{
+    filmstrip->setVisible(!filmstrip->isVisible());
 }
 
 void ImageWindow::process_finished(int exitCode)
 {
+    StallWatchdog::Scope stall("ImageWindow::process_finished");
+    QSize previousSize = sourceSize();
+    if (!croppedFilename.isEmpty())
+        ScratchManager::instance()->release(croppedFilename);
+    croppedFilename.clear();
     if (exitCode) {
         QString message = "The program said:\n"
                 + QString::fromUtf8(doubler->readAllStandardError());
         QMessageBox::critical(NULL, "Doubler failed.", message);
+        ScratchManager::instance()->release(doubledFilename);
+        fullDoublingsPending = 0;
+        emit doubled(sourceFilename, false);
         goto end;
     }
-    if (workingFilename != sourceFilename)
-        QFile(workingFilename).remove();
+    if (doublingRegion.isValid() && regionBaseFilename.isEmpty()) {
+        // Kept for when the framing wanders off the doubled part.
+        regionBaseFilename = workingFilename;
+        regionBaseProvenance = provenance;
+        regionBaseSize = previousSize;
+        regionBounds = QRectF(QPointF(0, 0), QSizeF(previousSize));
+        regionDoublings = 0;
+    } else if (workingFilename != sourceFilename
+               && workingFilename != regionBaseFilename) {
+        ScratchManager::instance()->release(workingFilename);
+    }
     workingFilename = doubledFilename;
+    provenance += doublingProvenance;
+    ScratchManager::instance()->update(workingFilename);
+    MemoryBudget::instance()->resize(workingCopyBudget,
+            ScratchManager::instance()->isInMemory(workingFilename)
+                ? QFileInfo(workingFilename).size() : 0);
+    if (!regionBaseFilename.isEmpty()) {
+        QPointF origin = doublingRegion.isValid() ? QPointF(doublingRegion.topLeft())
+                                                  : QPointF();
+        regionBounds = QRectF((regionBounds.topLeft() - origin) * 2,
+                              regionBounds.size() * 2);
+        regionDoublings++;
+    }
+    if (doublingRegion.isValid()) {
+        // The same point of the image has to stay under the same point of the
+        // frame, so the translation takes up the region's offset from the
+        // centre: t' = t + R(s d), with the scaling halved as usual.
+        QPointF d = QRectF(doublingRegion).center()
+                - QPointF(previousSize.width() / 2.0, previousSize.height() / 2.0);
+        transform.translation += QTransform().rotate(transform.rotation)
+                .map(d * transform.scaling);
+    }
     setScaledSource(doubledFilename, 1);
     showMessage("Doubling done");
+    emit doubled(sourceFilename, true);
+    if (fullDoublingsPending > 0) {
+        fullDoublingsPending--;
+        doubler->deleteLater();
+        doubler = NULL;
+        startDoubling(true);
+        return;
+    }
     end:
     doubler->deleteLater();
     doubler = NULL;
 }
 
+void ImageWindow::scheduler_frame(qint64 now)
+{
+    StallWatchdog::Scope stall("ImageWindow::scheduler_frame");
+    applyPendingInput();
+    if (!regionBaseFilename.isEmpty() && !regionCovers())
+        revertRegion();
+    if (!message.isEmpty() && opacity > 0.001) {
+        // 0.05 per 100ms, but only step while the fade is actually visible.
+        opacity -= (now - opacityTime) * 0.0005;
+        opacityTime = now;
+        if (opacity > 1.0)
+            scheduler.requestFrameIn((opacity - 1.0) / 0.0005);
+        else if (opacity > 0.001)
+            scheduler.requestFrameIn(33);
+    }
+    update();
+}
+
 void ImageWindow::setupBackground()
 {
     std::random_device rseed;
@@ -544,15 +816,90 @@ void ImageWindow::setupBackground()
             background.setPixel(x, y, 0x010101 * dist(rgen));
 }
 
+void ImageWindow::paintBackground(QPainter &p)
+{
+    QBrush fillBrush;
+    fillBrush.setTextureImage(background);
+    p.fillRect(QRect(0, 0, glWidth+1, glHeight+1), fillBrush);
+}
+
+void ImageWindow::paintMultiplied(QPainter &p, const QRect &windowRect)
+{
+    // Draw the source at screen resolution first, then apply the light to
+    // just those pixels, as the export does in linear light.
+    // The layer cannot be evicted while it is being painted; afterwards it
+    // goes back among the working buffers.
+    MemoryBudget *budget = MemoryBudget::instance();
+    budget->setPriority(layerBudget, MemoryBudget::Current);
+    QSize layerSize(glWidth, glHeight);
+    if (multiplyLayer.size() != layerSize) {
+        multiplyLayer = QImage(layerSize, QImage::Format_ARGB32_Premultiplied);
+        budget->resize(layerBudget, multiplyLayer.byteCount());
+    }
+    budget->touch(layerBudget);
+    multiplyLayer.fill(Qt::transparent);
+
+    QPainter lp(&multiplyLayer);
+    lp.setWindow(windowRect);
+    lp.setWorldTransform(transform.transform(displayScale));
+    lp.setRenderHint(QPainter::SmoothPixmapTransform);
+    drawSource(lp);
+    QRect painted = lp.combinedTransform()
+            .mapRect(QRectF(drawPoint, QSizeF(sourceSize()))).toAlignedRect()
+            & multiplyLayer.rect();
+    lp.end();
+    lightFilter.apply(multiplyLayer, painted);
+
+    QRect oldWindow = p.window();
+    p.setWindow(QRect(QPoint(0, 0), layerSize));
+    p.drawImage(painted.topLeft(), multiplyLayer, painted);
+    p.setWindow(oldWindow);
+    budget->setPriority(layerBudget, MemoryBudget::Working);
+}
+
+void ImageWindow::drawSource(QPainter &p)
+{
+    if (tiledSource.isOpen())
+        tiledSource.paint(p, drawPoint);
+    else
+        p.drawImage(drawPoint, source);
+}
+
+void ImageWindow::loadSource(const QString &filename)
+{
+    StallWatchdog::Scope stall("ImageWindow::loadSource");
+    if (TiledImage::wanted(QImageReader(filename).size())) {
+        source = QImage();
+        if (tiledSource.open(filename) && !tiledSource.isReady())
+            showMessage("Decoding a large image. Please wait.");
+    } else {
+        tiledSource.close();
+        if (!prefetcher || !prefetcher->take(filename, &source))
+            source = ImageDecoder::read(filename, QThread::idealThreadCount());
+    }
+    MemoryBudget::instance()->resize(sourceBudget, source.byteCount());
+}
+
+bool ImageWindow::hasSource()
+{
+    return !source.isNull() || tiledSource.isOpen();
+}
+
+QSize ImageWindow::sourceSize()
+{
+    return tiledSource.isOpen() ? tiledSource.size() : source.size();
+}
 
 void ImageWindow::setupActions()
 {
 #define MAKE_ACTION(x, y) \
     x = new QAction(y, this); \
     connect(x, &QAction::triggered, this, &ImageWindow::x##_triggered); \
+    connect(x, &QAction::triggered, ProcessGovernor::instance(), &ProcessGovernor::interacted); \
     addAction(x)
 
     MAKE_ACTION(actionExport, "Export");
+    MAKE_ACTION(actionExportGroup, "Export Group");
     MAKE_ACTION(actionEscape, "Escape");
     MAKE_ACTION(actionSkip, "Skip");
     MAKE_ACTION(actionDouble, "Double");
@@ -564,6 +911,7 @@ void ImageWindow::setupActions()
     MAKE_ACTION(actionResetRotation, "Reset Rotation");
     MAKE_ACTION(actionResetLocation, "Reset Location");
     MAKE_ACTION(actionShowRules, "Show Rules");
+    MAKE_ACTION(actionShowFilmstrip, "Show Filmstrip");
 
 #undef MAKE_ACTION
 }
@@ -580,8 +928,8 @@ void ImageWindow::cleanupActions()
 
 void ImageWindow::calculateDrawPoint()
 {
-    drawPoint = -QPointF(source.width()/2.0, source.height()/2.0);
-
+    QSize size = sourceSize();
+    drawPoint = -QPointF(size.width()/2.0, size.height()/2.0);
 }
 
 void ImageWindow::updateFields()
@@ -590,10 +938,99 @@ void ImageWindow::updateFields()
     noiseField = QStringList({"0: No noise", "1: Slight noise", "2: Heavy noise", "3: Excessive noise"}).at(noise);
 }
 
+void ImageWindow::applyPendingInput()
+{
+    if (mouseDelta.isNull())
+        return;
+    if (mouseCause == Qt::MiddleButton) {
+        // FIXME: move along angles when ctrl is pressed
+        transform.scaling -= mouseDelta.y()/100;
+    } else if (mouseCause == Qt::LeftButton) {
+        transform.translation += mouseDelta/displayScale;
+    } else if (mouseCause == Qt::RightButton) {
+        // FIXME: rotate around point of click
+        if (std::abs(transform.scaling) > 0.0001 )
+            transform.rotation += mouseDelta.x()/transform.scaling;
+    }
+    mouseDelta = QPointF();
+}
+
 void ImageWindow::removeWorkingCopy()
 {
-    if (workingFilename != sourceFilename) {
-        QFile f(workingFilename);
-        f.remove();
+    StallWatchdog::Scope stall("ImageWindow::removeWorkingCopy");
+    if (workingFilename != sourceFilename)
+        ScratchManager::instance()->release(workingFilename);
+    dropRegionBase();
+    MemoryBudget::instance()->resize(workingCopyBudget, 0);
+}
+
+QRectF ImageWindow::framedRegion()
+{
+    // What the frame shows, in the working copy's pixels.
+    QSizeF frame = emulatedSize_;
+    QSize size = sourceSize();
+    return transform.transform().inverted()
+            .mapRect(QRectF(QPointF(-frame.width() / 2, -frame.height() / 2), frame))
+            .translated(size.width() / 2.0, size.height() / 2.0);
+}
+
+bool ImageWindow::regionCovers()
+{
+    // Past the edges of the base there is nothing the doubled part could miss.
+    QRectF needed = framedRegion() & regionBounds;
+    if (needed.isEmpty())
+        return true;
+    QRectF have(QPointF(0, 0), QSizeF(sourceSize()));
+    return have.adjusted(-0.5, -0.5, 0.5, 0.5).contains(needed);
+}
+
+ImageCropping ImageWindow::regionBaseTransform()
+{
+    // A point p of the working copy, from its centre, is k p + d of the base.
+    QSize size = sourceSize();
+    qreal k = regionBaseSize.width() / regionBounds.width();
+    QPointF d = (QPointF(size.width() / 2.0, size.height() / 2.0)
+                 - regionBounds.topLeft()) * k
+            - QPointF(regionBaseSize.width() / 2.0, regionBaseSize.height() / 2.0);
+    ImageCropping t = transform;
+    t.scaling /= k;
+    t.translation -= QTransform().rotate(t.rotation).map(d * t.scaling);
+    return t;
+}
+
+void ImageWindow::revertRegion()
+{
+    StallWatchdog::Scope stall("ImageWindow::revertRegion");
+    // Back to the base as it was, then double all of it as many times as the
+    // part was, so that the framing is never short of pixels for long.
+    stop();
+    int doublings = regionDoublings;
+    transform = regionBaseTransform();
+    if (workingFilename != sourceFilename && workingFilename != regionBaseFilename)
+        ScratchManager::instance()->release(workingFilename);
+    workingFilename = regionBaseFilename;
+    provenance = regionBaseProvenance;
+    regionBaseFilename.clear();
+    regionDoublings = 0;
+    MemoryBudget::instance()->resize(workingCopyBudget,
+            workingFilename != sourceFilename
+                && ScratchManager::instance()->isInMemory(workingFilename)
+                ? QFileInfo(workingFilename).size() : 0);
+    loadSource(workingFilename);
+    calculateDrawPoint();
+    scheduler.requestFrame();
+    if (doublings > 0) {
+        startDoubling(true);
+        fullDoublingsPending = doublings - 1;
     }
+    showMessage("The framing left the doubled region. Doubling all of it.");
+}
+
+void ImageWindow::dropRegionBase()
+{
+    if (!regionBaseFilename.isEmpty() && regionBaseFilename != sourceFilename
+            && regionBaseFilename != workingFilename)
+        ScratchManager::instance()->release(regionBaseFilename);
+    regionBaseFilename.clear();
+    regionDoublings = 0;
 }
@@ -6,50 +6,66 @@
 #include <QPixmap>
 #include <ext/random>
 #include <QProcess>
+#include <QElapsedTimer>
+#include "linearmultiply.h"
+#include "framescheduler.h"
+#include "tiledimage.h"
+#include "imagecropping.h"
 
 class QAction;
-
-class ImageCropping {
-public:
-    ImageCropping();
-    static ImageCropping fromImage(const QImage &image);
-    void sourceScaledBy(int powerOf2);
-    QTransform transform(qreal initialScaling = 1.0);
-    QString toDisplayString();
-
-    QSize image;
-    qreal scaling;
-    qreal rotation;
-    QPointF translation;
-};
+class QPainter;
+class ImagePrefetcher;
+class Filmstrip;
+class DeferredExport;
 
 class ImageWindow : public QWidget {
     Q_OBJECT
+    friend class ImagingBenchmark;
     enum NoiseLevel { NoNoise, SlightNoise, HeavyNoise, ExcessiveNoise };
 public:
     ImageWindow(QWidget *parent = 0);
     ~ImageWindow();
     ImageCropping getTransform();
+    void setTransform(const ImageCropping &transform);
     void setDisplayScale(qreal factor);
     bool setExecutable(const QString &folder = QString());
     bool setModelDir(const QString &folder = QString());
     void setProcessor(int index);
+    void setRegionDoubling(bool enabled);
     void setEmulatedSize(QSize size);
+    QSize emulatedSizeFor(QSize window, qreal scale);
+    void setLightColor(const QColor &color);
+    void setFrameRateCap(int fps);
+    void setPrefetcher(ImagePrefetcher *prefetcher);
+    void setFilmstrip(const QStringList &previous, const QString &current,
+                      const QStringList &next);
 
     QStringList processors();
+    QString executablePath();
+    QString modelDir();
     QSize emulatedSize();
     bool isDone();
+    bool isDoubling();
+    QString workingProvenance();
+    void exportCurrent();
     void stop();
 
 signals:
     void exportFile(QString sourceFilename,
                     QString workingFilename,
                     ImageCropping transform);
+    void exportGroup(QString sourceFilename, QSize workingSize,
+                     ImageCropping transform);
+    void exportAfterDoubling(DeferredExport *pending);
     void escape();
     void skip();
+    void framePainted(qint64 nsecs);
+    void firstFramePainted(QString filename, qint64 nsecs);
+    void doubled(QString sourceFilename, bool ok);
 
 public slots:
     void setExportShortcut(const QKeySequence &shortcut);
+    void setExportGroupShortcut(const QKeySequence &shortcut);
     void setEscapeShortcut(const QKeySequence &shortcut);
     void setSkipShortcut(const QKeySequence &shortcut);
     void setDoubleShortcut(const QKeySequence &shortcut);
@@ -61,6 +77,7 @@ public slots:
     void setResetRotationShortcut(const QKeySequence &shortcut);
     void setResetLocationShortcut(const QKeySequence &shortcut);
     void setShowRulesShortcut(const QKeySequence &shortcut);
+    void setShowFilmstripShortcut(const QKeySequence &shortcut);
     void setSource(const QString &filename);
     void setScaledSource(const QString &filename, int powerOf2);
     void showMessage(const QString &message);
@@ -74,6 +91,7 @@ protected:
 
 private slots:
     void actionExport_triggered();
+    void actionExportGroup_triggered();
     void actionEscape_triggered();
     void actionSkip_triggered();
     void actionDouble_triggered();
@@ -85,15 +103,30 @@ private slots:
     void actionResetRotation_triggered();
     void actionResetLocation_triggered();
     void actionShowRules_triggered();
+    void actionShowFilmstrip_triggered();
     void process_finished(int exitCode);
+    void scheduler_frame(qint64 now);
 
 private:
     void setupBackground();
+    void paintBackground(QPainter &p);
+    void paintMultiplied(QPainter &p, const QRect &windowRect);
+    void drawSource(QPainter &p);
+    void loadSource(const QString &filename);
+    bool hasSource();
+    QSize sourceSize();
     void setupActions();
     void cleanupActions();
     void calculateDrawPoint();
     void updateFields();
     void removeWorkingCopy();
+    void applyPendingInput();
+    void startDoubling(bool wholeImage);
+    QRectF framedRegion();
+    bool regionCovers();
+    ImageCropping regionBaseTransform();
+    void revertRegion();
+    void dropRegionBase();
 
     bool done;
 
@@ -101,31 +134,58 @@ private:
     qreal displayScale;
     QImage background;
     QImage source;
+    TiledImage tiledSource;
+    ImagePrefetcher *prefetcher;
+    int sourceBudget;
+    int layerBudget;
+    int workingCopyBudget;
     QString executable;
     QString modelFolder;
     int processor;
     QString sourceFilename;
+    QElapsedTimer sourceTimer;
     QString workingFilename;
     QString doubledFilename;
+    QString croppedFilename;
+    QString provenance;
+    QString doublingProvenance;
     NoiseLevel noise;
+
+    // Region doubling: the working copy may cover only the part of an earlier
+    // copy, the base, that the framing needed.  regionBounds is where the
+    // whole base lies in the working copy's pixels.
+    bool regionDoubling;
+    QRect doublingRegion;
+    QString regionBaseFilename;
+    QString regionBaseProvenance;
+    QSize regionBaseSize;
+    QRectF regionBounds;
+    int regionDoublings;
+    int fullDoublingsPending;
     bool multiplying;
+    LinearMultiply lightFilter;
+    QImage multiplyLayer;
     bool rulesShown;
+    Filmstrip *filmstrip;
 
     ImageCropping transform;
     int glWidth;
     int glHeight;
     QPointF drawPoint;
 
+    FrameScheduler scheduler;
     QPointF mouseLast;
-    ImageCropping mouseTransform;
+    QPointF mouseDelta;
     Qt::MouseButton mouseCause;
 
     QString fileField;
     QString noiseField;
     QString message;
     qreal opacity;
+    qint64 opacityTime;
 
     QAction *actionExport;
+    QAction *actionExportGroup;
     QAction *actionEscape;
     QAction *actionSkip;
     QAction *actionDouble;
@@ -137,6 +197,7 @@ private:
     QAction *actionResetRotation;
     QAction *actionResetLocation;
     QAction *actionShowRules;
+    QAction *actionShowFilmstrip;
 
     QProcess *doubler;
 };
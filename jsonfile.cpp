@@ -0,0 +1,29 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QUuid>
+#include "jsonfile.h"
+
+QJsonObject JsonFile::read(const QString &filename)
+{
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly))
+        return QJsonObject();
+    return QJsonDocument::fromJson(f.readAll()).object();
+}
+
+bool JsonFile::write(const QString &tmpFolder, const QString &filename,
+                     const QJsonObject &json)
+{
+    QString tmp = tmpFolder + "/" + QUuid::createUuid().toString().mid(1, 36);
+    QFile f(tmp);
+    if (!f.open(QFile::WriteOnly))
+        return false;
+    f.write(QJsonDocument(json).toJson());
+    f.close();
+    QFile::remove(filename);
+    if (!QFile::rename(tmp, filename)) {
+        QFile::remove(tmp);
+        return false;
+    }
+    return true;
+}
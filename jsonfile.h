@@ -0,0 +1,18 @@
+#ifndef JSONFILE_H
+#define JSONFILE_H
+
+#include <QJsonObject>
+#include <QString>
+
+// Small JSON documents in folders that several processes, possibly on other
+// hosts, read and write at once.
+class JsonFile {
+public:
+    static QJsonObject read(const QString &filename);
+    // Written into tmpFolder, on the same filesystem, and renamed into place,
+    // so that readers see either nothing or the whole file.
+    static bool write(const QString &tmpFolder, const QString &filename,
+                      const QJsonObject &json);
+};
+
+#endif // JSONFILE_H
@@ -0,0 +1,138 @@
+#include <cmath>
+#include "linearmultiply.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LINEARMULTIPLY_AVX2
+#endif
+
+struct LinearTable {
+    float values[256];
+    LinearTable() {
+        for (int i = 0; i < 256; i++) {
+            float c = i / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f
+                                      : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+};
+
+static const float *linearTable()
+{
+    static const LinearTable table;
+    return table.values;
+}
+
+static void applyScalar(quint32 *line, int count, const quint32 *red,
+                        const quint32 *green, const quint32 *blue)
+{
+    for (int i = 0; i < count; i++) {
+        quint32 px = line[i];
+        quint32 a = px >> 24;
+        if (a == 0xff) {
+            line[i] = 0xff000000 | red[(px >> 16) & 0xff]
+                    | green[(px >> 8) & 0xff] | blue[px & 0xff];
+        } else if (a) {
+            // Edge pixels of the premultiplied layer; rare enough to divide.
+            QRgb c = qUnpremultiply(px);
+            line[i] = qPremultiply(qRgba(red[qRed(c)] >> 16,
+                                         green[qGreen(c)] >> 8,
+                                         blue[qBlue(c)], a));
+        }
+    }
+}
+
+#ifdef LINEARMULTIPLY_AVX2
+__attribute__((target("avx2")))
+static void applyAvx2(quint32 *line, int count, const quint32 *red,
+                      const quint32 *green, const quint32 *blue)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i alpha = _mm256_set1_epi32(0xff000000);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + i));
+        __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(px, alpha), alpha);
+        if (_mm256_movemask_epi8(opaque) != -1) {
+            applyScalar(line + i, 8, red, green, blue);
+            continue;
+        }
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+        __m256i b = _mm256_and_si256(px, mask);
+        r = _mm256_i32gather_epi32(reinterpret_cast<const int*>(red), r, 4);
+        g = _mm256_i32gather_epi32(reinterpret_cast<const int*>(green), g, 4);
+        b = _mm256_i32gather_epi32(reinterpret_cast<const int*>(blue), b, 4);
+        __m256i out = _mm256_or_si256(_mm256_or_si256(alpha, r),
+                                      _mm256_or_si256(g, b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(line + i), out);
+    }
+    applyScalar(line + i, count - i, red, green, blue);
+}
+
+static bool haveAvx2()
+{
+    static bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+
+
+LinearMultiply::LinearMultiply()
+{
+    setLight(QColor(0xff, 0xff, 0xff));
+}
+
+void LinearMultiply::setLight(const QColor &light)
+{
+    light_ = light;
+    float lr = toLinear(light.red());
+    float lg = toLinear(light.green());
+    float lb = toLinear(light.blue());
+    for (int i = 0; i < 256; i++) {
+        float c = toLinear(i);
+        red[i] = fromLinear(c * lr) << 16;
+        green[i] = fromLinear(c * lg) << 8;
+        blue[i] = fromLinear(c * lb);
+    }
+}
+
+QColor LinearMultiply::light() const
+{
+    return light_;
+}
+
+void LinearMultiply::apply(QImage &image, const QRect &rect, bool allowSimd) const
+{
+    if (image.format() != QImage::Format_RGB32
+            && image.format() != QImage::Format_ARGB32_Premultiplied)
+        return;
+    QRect r = rect & image.rect();
+    if (r.isEmpty() || light_ == QColor(0xff, 0xff, 0xff))
+        return;
+
+    auto kernel = applyScalar;
+#ifdef LINEARMULTIPLY_AVX2
+    if (allowSimd && haveAvx2())
+        kernel = applyAvx2;
+#else
+    (void)allowSimd;
+#endif
+    for (int y = r.top(); y <= r.bottom(); y++) {
+        quint32 *line = reinterpret_cast<quint32*>(image.scanLine(y)) + r.left();
+        kernel(line, r.width(), red, green, blue);
+    }
+}
+
+float LinearMultiply::toLinear(int srgb)
+{
+    return linearTable()[srgb & 0xff];
+}
+
+int LinearMultiply::fromLinear(float linear)
+{
+    float c = linear <= 0.0031308f ? linear * 12.92f
+                                   : 1.055f * std::pow(linear, 1 / 2.4f) - 0.055f;
+    return qBound(0, (int)std::lround(c * 255), 255);
+}
@@ -0,0 +1,30 @@
+#ifndef LINEARMULTIPLY_H
+#define LINEARMULTIPLY_H
+
+#include <QColor>
+#include <QImage>
+#include <QRect>
+
+// Multiplies pixels by the export light colour in linear light.  The sRGB
+// decode, multiply and encode are folded into one table per channel whenever
+// the light changes, so each pixel costs three lookups.
+class LinearMultiply {
+public:
+    LinearMultiply();
+    void setLight(const QColor &light);
+    QColor light() const;
+
+    // Works in place on Format_RGB32 or Format_ARGB32_Premultiplied images.
+    void apply(QImage &image, const QRect &rect, bool allowSimd = true) const;
+
+    static float toLinear(int srgb);
+    static int fromLinear(float linear);
+
+private:
+    QColor light_;
+    quint32 red[256];
+    quint32 green[256];
+    quint32 blue[256];
+};
+
+#endif // LINEARMULTIPLY_H
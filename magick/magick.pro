@@ -0,0 +1,14 @@
+# Runs convert command lines sent on stdin inside one long-lived process, so
+# that exports do not pay for starting ImageMagick each time.  darkcropper
+# finds it next to itself and falls back to convert when it is missing.
+
+TARGET = darkcropper-magick
+TEMPLATE = app
+QT = core
+CONFIG += console C++11 link_pkgconfig
+CONFIG -= app_bundle
+
+PKGCONFIG += MagickWand
+system(pkg-config --atleast-version=7 MagickWand): DEFINES += MAGICK7
+
+SOURCES += magickhelper.cpp
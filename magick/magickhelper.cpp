@@ -0,0 +1,87 @@
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QVector>
+
+#ifdef MAGICK7
+#include <MagickWand/MagickWand.h>
+#else
+#include <wand/MagickWand.h>
+#endif
+
+// One request per line on stdin, {"id": n, "args": [...]}, where args are what
+// would follow "convert" on a command line; one reply per line on stdout,
+// {"id": n, "ok": bool, "error": "...", "ms": n}.  The helper exits at the end
+// of its input.
+
+static bool convert(const QJsonArray &args, QString *error)
+{
+    QList<QByteArray> storage;
+    storage << "convert";
+    for (const QJsonValue &arg : args)
+        storage << arg.toString().toLocal8Bit();
+    QVector<char*> argv;
+    for (QByteArray &arg : storage)
+        argv << arg.data();
+    argv << NULL;
+
+    ImageInfo *info = AcquireImageInfo();
+    ExceptionInfo *exception = AcquireExceptionInfo();
+    MagickBooleanType ok = MagickCommandGenesis(info, ConvertImageCommand,
+                                                storage.count(), argv.data(),
+                                                NULL, exception);
+    if (exception->severity != UndefinedException && exception->reason) {
+        *error = QString::fromLocal8Bit(exception->reason);
+        if (exception->description)
+            *error += QString(" (%1)").arg(QString::fromLocal8Bit(exception->description));
+    }
+    DestroyExceptionInfo(exception);
+    DestroyImageInfo(info);
+
+    // mpr: images stay in the registry for the life of the process, and the
+    // export pipeline leaves a whole source there each time.
+    QList<QByteArray> keys;
+    ResetImageRegistryIterator();
+    while (const char *key = GetNextImageRegistry())
+        keys << key;
+    for (const QByteArray &key : keys)
+        DeleteImageRegistry(key.constData());
+    return ok == MagickTrue;
+}
+
+int main(int argc, char *argv[])
+{
+    MagickWandGenesis();
+    Q_UNUSED(argc);
+    Q_UNUSED(argv);
+
+    QFile in, out;
+    in.open(stdin, QFile::ReadOnly);
+    out.open(stdout, QFile::WriteOnly | QFile::Unbuffered);
+    while (true) {
+        QByteArray line = in.readLine();
+        if (line.isEmpty())
+            break;
+        QJsonObject request = QJsonDocument::fromJson(line).object();
+        if (request.isEmpty())
+            continue;
+
+        QElapsedTimer timer;
+        timer.start();
+        QString error;
+        bool ok = convert(request["args"].toArray(), &error);
+
+        QJsonObject reply;
+        reply["id"] = request["id"];
+        reply["ok"] = ok;
+        reply["error"] = error;
+        reply["ms"] = double(timer.elapsed());
+        out.write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n");
+    }
+
+    MagickWandTerminus();
+    return 0;
+}
@@ -0,0 +1,144 @@
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QStandardPaths>
+#include "magickpool.h"
+#include "processgovernor.h"
+
+// Jobs a helper runs before it is retired.
+static const int helperLifetime = 100;
+
+MagickPool::MagickPool(QObject *parent)
+    : QObject(parent), program(helperPath()), broken(false), size(1)
+{
+}
+
+MagickPool::~MagickPool()
+{
+    // Helpers finish the job in hand and exit once their input is closed.
+    for (QProcess *p : helpers.keys()) {
+        p->disconnect(this);
+        p->closeWriteChannel();
+        p->setParent(0);
+    }
+}
+
+QString MagickPool::helperPath()
+{
+    // DARKCROPPER_MAGICK names the helper; set but empty, it turns it off.
+    if (qEnvironmentVariableIsSet("DARKCROPPER_MAGICK"))
+        return QString::fromLocal8Bit(qgetenv("DARKCROPPER_MAGICK"));
+    QString here = QCoreApplication::applicationDirPath();
+    QStringList candidates;
+    candidates << here + "/darkcropper-magick"
+               << here + "/magick/darkcropper-magick"
+               << QStandardPaths::findExecutable("darkcropper-magick");
+    for (const QString &candidate : candidates)
+        if (!candidate.isEmpty() && QFileInfo(candidate).isExecutable())
+            return candidate;
+    return QString();
+}
+
+bool MagickPool::isAvailable() const
+{
+    return !program.isEmpty() && !broken;
+}
+
+void MagickPool::setSize(int helpers)
+{
+    size = qMax(1, helpers);
+}
+
+bool MagickPool::run(int id, const QStringList &convertArguments)
+{
+    if (!isAvailable())
+        return false;
+    // Helpers on their way out still finish, but take no more jobs.
+    QProcess *process = 0;
+    int serving = 0;
+    for (auto it = helpers.begin(); it != helpers.end(); ++it) {
+        if (it->served >= helperLifetime)
+            continue;
+        serving++;
+        if (!process && it->job < 0 && it.key()->state() == QProcess::Running)
+            process = it.key();
+    }
+    if (!process) {
+        if (serving >= size)
+            return false;
+        process = spawn();
+    }
+
+    QJsonObject request;
+    request["id"] = id;
+    request["args"] = QJsonArray::fromStringList(convertArguments);
+    helpers[process].job = id;
+    process->write(QJsonDocument(request).toJson(QJsonDocument::Compact) + "\n");
+    return true;
+}
+
+QProcess *MagickPool::spawn()
+{
+    QProcess *p = ProcessGovernor::instance()->create(this);
+    p->setProgram(program);
+    p->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    connect(p, &QProcess::readyReadStandardOutput, this, [this, p]() {
+        readReplies(p);
+    });
+    connect(p, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, [this, p]() {
+        helperExited(p);
+    });
+    connect(p, &QProcess::errorOccurred, this, [this, p](QProcess::ProcessError e) {
+        if (e != QProcess::FailedToStart)
+            return;
+        // Not worth retrying for every export; convert takes over for good.
+        broken = true;
+        helperExited(p);
+    });
+    Helper h;
+    h.job = -1;
+    h.served = 0;
+    helpers.insert(p, h);
+    p->start();
+    return p;
+}
+
+void MagickPool::readReplies(QProcess *process)
+{
+    auto it = helpers.find(process);
+    if (it == helpers.end())
+        return;
+    it->buffer += process->readAllStandardOutput();
+    int newline;
+    while ((newline = it->buffer.indexOf('\n')) >= 0) {
+        QJsonObject reply = QJsonDocument::fromJson(it->buffer.left(newline)).object();
+        it->buffer.remove(0, newline + 1);
+        if (reply.isEmpty())
+            continue;
+        it->job = -1;
+        if (++it->served >= helperLifetime)
+            process->closeWriteChannel();
+        // Listeners may hand this helper its next job straight away.
+        emit finished(reply["id"].toInt(), reply["ok"].toBool(),
+                      reply["error"].toString());
+        it = helpers.find(process);
+        if (it == helpers.end())
+            return;
+    }
+}
+
+void MagickPool::helperExited(QProcess *process)
+{
+    auto it = helpers.find(process);
+    if (it == helpers.end())
+        return;
+    int job = it->job;
+    helpers.erase(it);
+    process->deleteLater();
+    if (job >= 0)
+        emit lost(job);
+}
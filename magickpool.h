@@ -0,0 +1,47 @@
+#ifndef MAGICKPOOL_H
+#define MAGICKPOOL_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+
+class QProcess;
+
+// Long-lived darkcropper-magick helpers that run convert command lines
+// in-process, one job each at a time, so that an export does not pay for
+// starting ImageMagick.  Helpers are started as jobs need them, up to the
+// pool size, and replaced after a while to keep ImageMagick's leaks in check.
+class MagickPool : public QObject {
+    Q_OBJECT
+public:
+    MagickPool(QObject *parent = 0);
+    ~MagickPool();
+
+    static QString helperPath();
+    bool isAvailable() const;
+    void setSize(int helpers);
+    bool run(int id, const QStringList &convertArguments);
+
+signals:
+    void finished(int id, bool ok, QString error);
+    // The helper running this job went away without answering.
+    void lost(int id);
+
+private:
+    struct Helper {
+        int job;
+        int served;
+        QByteArray buffer;
+    };
+
+    QProcess *spawn();
+    void readReplies(QProcess *process);
+    void helperExited(QProcess *process);
+
+    QString program;
+    bool broken;
+    int size;
+    QHash<QProcess*, Helper> helpers;
+};
+
+#endif // MAGICKPOOL_H
@@ -1,5 +1,9 @@
 #include <QSurfaceFormat>
+#include <QCommandLineParser>
 #include "mainwindow.h"
+#include "sessionrecorder.h"
+#include "controlserver.h"
+#include "stallwatchdog.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
@@ -7,8 +11,48 @@ int main(int argc, char *argv[])
     QCoreApplication::setApplicationName("Dark Cropper");
     QCoreApplication::setOrganizationName("cmdrkotori");
     QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption recordOption("record",
+            "Record the session as a replay trace to <file>.", "file");
+    QCommandLineOption controlOption("control",
+            "Listen for darkcropper-ctl on the local socket <name>.", "name",
+            "darkcropper");
+    QCommandLineOption noControlOption("no-control",
+            "Do not open the control socket.");
+    QCommandLineOption stallOption("stall-threshold",
+            "Log GUI stalls longer than <ms> milliseconds; 0 turns it off.", "ms",
+            "50");
+    QCommandLineOption stallLogOption("stall-log",
+            "Write the stall log to <file>.", "file");
+    parser.addOptions({ recordOption, controlOption, noControlOption,
+                        stallOption, stallLogOption });
+    parser.process(a);
+
     MainWindow w;
+    if (parser.isSet(recordOption)) {
+        SessionRecorder *recorder = new SessionRecorder(parser.value(recordOption), &w);
+        if (recorder->isOpen())
+            w.setRecorder(recorder);
+    }
+    if (!parser.isSet(noControlOption)) {
+        ControlServer *control = new ControlServer(&w, &w);
+        if (!control->listen(parser.value(controlOption)))
+            qWarning("could not listen on control socket %s",
+                     qPrintable(parser.value(controlOption)));
+    }
     w.show();
 
-    return a.exec();
+    StallWatchdog *watchdog = StallWatchdog::instance();
+    int threshold = parser.value(stallOption).toInt();
+    if (threshold > 0) {
+        watchdog->setThreshold(threshold);
+        if (parser.isSet(stallLogOption))
+            watchdog->setLogFile(parser.value(stallLogOption));
+        watchdog->startWatching();
+    }
+    int r = a.exec();
+    watchdog->stopWatching();
+    return r;
 }
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <QApplication>
 #include <QLineEdit>
+#include <QSpinBox>
 #include <QDesktopWidget>
 #include <QSettings>
 #include <QFileDialog>
@@ -10,10 +14,38 @@
 #include <QDragEnterEvent>
 #include <QDropEvent>
 #include <QMimeData>
+#include <QImageReader>
+#include <QThread>
 
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "imagewindow.h"
+#include "exportjob.h"
+#include "sessionrecorder.h"
+#include "memorybudget.h"
+#include "folderwatcher.h"
+#include "imageprefetcher.h"
+#include "imageindex.h"
+#include "scratchmanager.h"
+#include "tiledimage.h"
+#include "filmstrip.h"
+#include "exportindex.h"
+#include "processgovernor.h"
+#include "groupreview.h"
+#include "processorcalibration.h"
+#include "spoolmonitor.h"
+#include "deferredexport.h"
+#include "stallwatchdog.h"
+
+static const int prefetchDepth = 2;
+static const int heartbeatInterval = 5000;
+static const int leaseExpiry = 30;
+static const int filmstripDepth = 5;
+static const int SequenceRole = Qt::UserRole;
+
+enum QueueSort { SortQueueOrder, SortLargestFirst, SortSmallestFirst,
+                 SortNeedsDoublingFirst };
+enum QueueFilter { FilterAll, FilterNeedsDoubling, FilterNoDoubling };
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -22,12 +54,94 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 
     cropper = new ImageWindow();
+    prefetcher = new ImagePrefetcher(this);
+    cropper->setPrefetcher(prefetcher);
+    watcher = new FolderWatcher(this);
+    connect(watcher, &FolderWatcher::filesReady,
+            this, &MainWindow::watcher_filesReady);
+    index = new ImageIndex(this);
+    nextSequence = 0;
+    sortingQueue = false;
+    calibration = new ProcessorCalibration(this);
+    connect(calibration, &ProcessorCalibration::progress,
+            this, [this](int done, int total) {
+        ui->waifu2xCalibration->setText(QString("Calibrating, %1 of %2 runs")
+                                        .arg(done + 1).arg(total));
+    });
+    connect(calibration, &ProcessorCalibration::finished,
+            this, &MainWindow::calibration_finished);
+    exportQueue = new ExportQueue(this);
+    connect(exportQueue, &ExportQueue::finished,
+            this, &MainWindow::exportQueue_finished);
+    connect(exportQueue, &ExportQueue::spooled,
+            this, &MainWindow::exportQueue_spooled);
+    connect(exportQueue, &ExportQueue::retrying,
+            this, [this](ExportJob, int attempt, QString, int delayMsecs) {
+        exportRetries++;
+        cropper->showMessage(QString("Export failed, retrying in %1 s (attempt %2)")
+                             .arg(delayMsecs / 1000).arg(attempt + 1));
+    });
+    exportsDone = exportsFailed = exportRetries = deferredExports = 0;
+    skipped = autoCropped = grouped = 0;
+    exportTime = 0;
+    sessionTimer.start();
+    spoolMonitor = new SpoolMonitor(this);
+    connect(spoolMonitor, &SpoolMonitor::polled,
+            this, [this](int waiting, int claimed, int workers, int failed) {
+        if (!ui->spoolExport->isChecked())
+            return;
+        QString text = QString("Spool: %1 waiting, %2 rendering, %3 workers")
+                .arg(waiting).arg(claimed).arg(workers);
+        if (failed)
+            text += QString(", %1 given up").arg(failed);
+        ui->spoolStatus->setText(text);
+    });
+    spoolTimer.setInterval(2000);
+    connect(&spoolTimer, &QTimer::timeout,
+            this, &MainWindow::updateSpoolStatus);
+    operatorName = ExportSpool::workerName();
+    sharedQueueTimer.setInterval(heartbeatInterval);
+    connect(&sharedQueueTimer, &QTimer::timeout,
+            this, &MainWindow::updateSharedQueue);
+    connect(ui->sharedQueueFolder, &QLineEdit::editingFinished,
+            this, [this]() {
+        if (ui->sharedQueue->isChecked())
+            joinSharedQueue();
+    });
+    connect(cropper, &ImageWindow::doubled, this, &MainWindow::fileDoubled);
+    annotateTimer.setSingleShot(true);
+    annotateTimer.setInterval(200);
+    connect(&annotateTimer, &QTimer::timeout,
+            this, &MainWindow::annotateQueue);
+    connect(index, &ImageIndex::probed,
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(ui->fileList->model(), &QAbstractItemModel::rowsInserted,
+            this, &MainWindow::fileList_rowsInserted);
+    connect(ui->queueSort, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, &MainWindow::sortQueue);
+    connect(ui->queueFilter, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, &MainWindow::annotateQueue);
+    connect(ui->fullscreen, &QRadioButton::toggled,
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(ui->windowedSize, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(ui->fullscreenScreen, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(ui->folderSettle, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            watcher, &FolderWatcher::setSettleTime);
+    connect(ui->folderText, &QLineEdit::textChanged,
+            this, [this](const QString &text) {
+        if (ui->folderWatch->isChecked())
+            watcher->setFolder(text);
+    });
     connect(ui->waifu2xExecutable, &QLineEdit::textEdited,
             this, &MainWindow::checkFolders);
     connect(ui->waifu2xModelDir, &QLineEdit::textEdited,
             this, &MainWindow::checkFolders);
     connect(ui->exportEdit, &QKeySequenceEdit::keySequenceChanged,
             cropper, &ImageWindow::setExportShortcut);
+    connect(ui->exportGroupEdit, &QKeySequenceEdit::keySequenceChanged,
+            cropper, &ImageWindow::setExportGroupShortcut);
     connect(ui->escapeEdit, &QKeySequenceEdit::keySequenceChanged,
             cropper, &ImageWindow::setEscapeShortcut);
     connect(ui->skipEdit, &QKeySequenceEdit::keySequenceChanged,
@@ -48,9 +162,77 @@ MainWindow::MainWindow(QWidget *parent) :
             cropper, &ImageWindow::setResetRotationShortcut);
     connect(ui->resetLocationEdit, &QKeySequenceEdit::keySequenceChanged,
             cropper, &ImageWindow::setResetLocationShortcut);
+    connect(ui->showFilmstripEdit, &QKeySequenceEdit::keySequenceChanged,
+            cropper, &ImageWindow::setShowFilmstripShortcut);
+    connect(ui->fileList, &QListWidget::currentRowChanged,
+            this, &MainWindow::updateFilmstrips);
+    connect(ui->filmstrip, &Filmstrip::activated,
+            this, [this](QString filename) {
+        for (int i = 0; i < ui->fileList->count(); i++) {
+            if (ui->fileList->item(i)->text() == filename) {
+                ui->fileList->setCurrentRow(i);
+                break;
+            }
+        }
+    });
+
+    connect(ui->exportJobs, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            exportQueue, &ExportQueue::setConcurrency);
+    connect(ui->autoCrop, &QCheckBox::toggled,
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(ui->autoCropTolerance, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged),
+            &annotateTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    ProcessGovernor *governor = ProcessGovernor::instance();
+    connect(ui->childNice, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            governor, &ProcessGovernor::setNice);
+    connect(ui->childIoClass, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            governor, [governor](int index) {
+        governor->setIoClass(ProcessGovernor::IoClass(index));
+    });
+    connect(ui->childThreads, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            governor, &ProcessGovernor::setThreadLimit);
+    connect(ui->reserveCore, &QCheckBox::toggled,
+            governor, &ProcessGovernor::setReserveCore);
+    // Settings that match the form's defaults do not emit a change on load.
+    exportQueue->setConcurrency(ui->exportJobs->value());
+    governor->setNice(ui->childNice->value());
+    governor->setIoClass(ProcessGovernor::IoClass(ui->childIoClass->currentIndex()));
+
+    connect(ui->frameRateCap, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            cropper, &ImageWindow::setFrameRateCap);
+    connect(ui->memoryBudget, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, [](int mib) {
+        MemoryBudget::instance()->setBudget(qint64(mib) << 20);
+    });
+    connect(MemoryBudget::instance(), &MemoryBudget::changed,
+            this, &MainWindow::updateBudgetStatus);
+    connect(ui->scratchFolder, &QLineEdit::textChanged,
+            this, [](const QString &text) {
+        ScratchManager::instance()->setFolder(text.isEmpty() ? QString("/dev/shm")
+                                                             : text);
+    });
+    connect(ui->scratchQuota, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, [](int mib) {
+        ScratchManager::instance()->setQuota(qint64(mib) << 20);
+    });
+    connect(ScratchManager::instance(), &ScratchManager::changed,
+            this, &MainWindow::updateScratchStatus);
+    connect(ui->lightColor, &QLineEdit::textChanged,
+            this, [this]() {
+        cropper->setLightColor(exportLight());
+    });
+
+    connect(ui->doubleRegion, &QCheckBox::toggled,
+            cropper, &ImageWindow::setRegionDoubling);
+    cropper->setRegionDoubling(ui->doubleRegion->isChecked());
 
     connect(cropper, &ImageWindow::exportFile,
             this, &MainWindow::cropper_export);
+    connect(cropper, &ImageWindow::exportGroup,
+            this, &MainWindow::cropper_exportGroup);
+    connect(cropper, &ImageWindow::exportAfterDoubling,
+            this, &MainWindow::cropper_exportAfterDoubling);
     connect(cropper, &ImageWindow::escape,
             this, &MainWindow::cropper_escape);
     connect(cropper, &ImageWindow::skip,
@@ -59,79 +241,342 @@ MainWindow::MainWindow(QWidget *parent) :
     populateScreens();
     loadSettings();
     updateActions();
+    updateScratchStatus();
+    updateFailedStatus();
+
+    // The first time this waifu2x is seen here, find out which processor suits
+    // it rather than leave the operator to guess; once known, or once the
+    // operator has said no, only on request.
+    ProcessorCalibration::Results results;
+    if (ui->waifu2xProcessor->count() > 1
+            && !ProcessorCalibration::load(cropper->executablePath(),
+                                           cropper->modelDir(), &results)
+            && !ProcessorCalibration::isDeclined(cropper->executablePath(),
+                                                 cropper->modelDir()))
+        on_waifu2xCalibrate_clicked();
+
+    // Working copies left behind by instances which are no longer running.
+    ScratchManager::instance()->removeOrphans();
+    ScratchManager::removeOrphans(TiledImage::cacheFolder());
 }
 
 MainWindow::~MainWindow()
 {
     saveSettings();
+    leaveSharedQueue();
     delete ui;
     delete cropper;
 }
 
+int MainWindow::enqueue(const QStringList &files)
+{
+    QSet<QString> queued = queuedFiles();
+    QStringList added;
+    for (const QString &file : files) {
+        QString path = QFileInfo(file).absoluteFilePath();
+        if (queued.contains(path))
+            continue;
+        queued.insert(path);
+        added << path;
+    }
+    ui->fileList->addItems(added);
+    return added.count();
+}
+
+QStringList MainWindow::queue(int offset, int limit)
+{
+    QStringList files;
+    for (int i = qMax(0, offset); i < ui->fileList->count() && files.count() < limit; i++)
+        files << ui->fileList->item(i)->text();
+    return files;
+}
+
+QJsonObject MainWindow::status()
+{
+    int hidden = 0;
+    for (int i = 0; i < ui->fileList->count(); i++)
+        if (ui->fileList->item(i)->isHidden())
+            hidden++;
+    double minutes = sessionTimer.elapsed() / 60000.0;
+
+    QJsonObject queued;
+    queued["length"] = ui->fileList->count();
+    queued["filtered_out"] = hidden;
+    queued["probing"] = index->pending();
+    queued["current"] = queueHead;
+    QJsonObject exports;
+    exports["running"] = exportQueue->running();
+    exports["waiting"] = exportQueue->waiting();
+    exports["done"] = exportsDone;
+    exports["failed"] = exportsFailed;
+    exports["retries"] = exportRetries;
+    exports["failed_kept"] = failedJobs.count();
+    exports["mean_ms"] = exportsDone ? double(exportTime) / exportsDone : 0.0;
+    exports["per_minute"] = minutes > 0 ? exportsDone / minutes : 0.0;
+    QJsonObject doubling;
+    doubling["running"] = cropper->isDoubling();
+    doubling["awaiting_export"] = deferredExports;
+    QJsonObject shared;
+    shared["enabled"] = sharingQueue();
+    shared["holding"] = claimedAhead.count();
+    if (sharingQueue()) {
+        shared["claimed"] = sharedQueue.claimed();
+        shared["done"] = sharedQueue.done();
+        shared["operators"] = sharedQueue.operators(leaseExpiry).count();
+    }
+    MemoryBudget *budget = MemoryBudget::instance();
+    QJsonObject memory;
+    memory["usage"] = double(budget->usage());
+    memory["budget"] = double(budget->budget());
+    memory["evictions"] = budget->evictions();
+    ScratchManager *scratch = ScratchManager::instance();
+    QJsonObject scratchSpace;
+    scratchSpace["usage"] = double(scratch->usage());
+    scratchSpace["quota"] = double(scratch->quota());
+
+    QJsonObject r;
+    r["uptime_ms"] = double(sessionTimer.elapsed());
+    r["cropping"] = !cropper->isDone();
+    r["skipped"] = skipped;
+    r["auto_cropped"] = autoCropped;
+    r["grouped"] = grouped;
+    r["queue"] = queued;
+    r["exports"] = exports;
+    r["doubling"] = doubling;
+    r["shared_queue"] = shared;
+    r["memory"] = memory;
+    r["scratch"] = scratchSpace;
+    r["stalls"] = StallWatchdog::instance()->summary();
+    return r;
+}
+
+void MainWindow::setRecorder(SessionRecorder *recorder)
+{
+    recorder->attach(this, cropper);
+}
+
 void MainWindow::cropper_export(QString sourceFilename,
                                 QString workingFilename,
                                 ImageCropping transform)
 {
-    QFileInfo info(sourceFilename);
-    QString appendage = "_cropped.png";
-    QString outfile = QString("%1/%2%3")
-            .arg(ui->sameFolder->isChecked() ? info.absolutePath()
-                                             : ui->otherFolderText->text())
-            .arg(info.completeBaseName().left(255 - appendage.length()))
-            .arg(appendage);
+    StallWatchdog::Scope stall("MainWindow::cropper_export");
+    ExportJob job;
+    job.sourceFilename = sourceFilename;
+    job.workingFilename = workingFilename;
+    job.outputFilename = outputFilename(sourceFilename);
+    job.transform = transform;
+    job.size = cropper->emulatedSize();
+    job.light = exportLight().name();
+    job.provenance = cropper->workingProvenance();
+    submitExport(job);
+    fileList_chewTop();
+    cropper_nextFile();
+}
 
-    auto sizeToString = [](const QSize &sz) {
-        return QString("%1x%2")
-                .arg(sz.width())
-                .arg(sz.height());
-    };
-    auto placeToString = [](const QPointF &sz) {
-        return QString("%1%2%3%4")
-                .arg(sz.x() < 0 ? "" : "+").arg(sz.x(), 0, 'f', 5)
-                .arg(sz.y() < 0 ? "" : "+").arg(sz.y(), 0, 'f', 5);
-    };
-    QColor light = QColor(ui->lightColor->text());
-    if (!light.isValid())
-        light = QColor("#FFFFFF");
-    QProcess *p = new QProcess;
-    QStringList args;
-    args << workingFilename
-         << "-colorspace" << "RGB"
-         << "-virtual-pixel" << "white"
-         << "+distort" << "SRT"
-         << QString("%1,%2 %3 %4 %1,%2").arg(transform.image.width()/2)
-                                        .arg(transform.image.height()/2)
-                                        .arg(transform.scaling, 0, 'f', 5)
-                                        .arg(transform.rotation, 0, 'f', 5)
-         << "-write" << "mpr:src"
-         << "+delete"
-         << "-background" << "rgba(48,48,48)"
-         << "-size" << sizeToString(cropper->emulatedSize())
-         << "mpr:src"
-         << "-gravity" << "center"
-         << "-geometry" << placeToString(transform.translation)
-         << "-size" << sizeToString(cropper->emulatedSize())
-         << "-colorspace" << "sRGB"
-         << QString("xc:%1").arg(light.name())
-         << "+swap"
-         << "-compose" << "multiply"
-         << "-composite" << outfile;
-    p->setProgram("convert");
-    p->setArguments(args);
-    QString fileToRemove = sourceFilename != workingFilename ? workingFilename
-                                                             : QString();
-    connect(p, static_cast<void (QProcess::*)(int)>(&QProcess::finished), [=]() {
-        process_finished(fileToRemove);
-    });
-    connect(p, static_cast<void (QProcess::*)(int)>(&QProcess::finished), [p]() {
-        p->deleteLater();
+void MainWindow::cropper_exportAfterDoubling(DeferredExport *pending)
+{
+    StallWatchdog::Scope stall("MainWindow::cropper_exportAfterDoubling");
+    // Output, size and light are settled now, as for any other export; only
+    // the working copy and the framing on it wait for waifu2x.
+    QString output = outputFilename(pending->sourceFilename());
+    QSize size = cropper->emulatedSize();
+    QColor light = exportLight();
+    deferredExports++;
+    connect(pending, &DeferredExport::doubled, this, &MainWindow::fileDoubled);
+    connect(pending, &DeferredExport::ready, this,
+            [this, output, size, light](QString sourceFilename, QString workingFilename,
+                                        ImageCropping transform, QString provenance) {
+        deferredExports--;
+        ExportJob job;
+        job.sourceFilename = sourceFilename;
+        job.workingFilename = workingFilename;
+        job.outputFilename = output;
+        job.transform = transform;
+        job.size = size;
+        job.light = light.name();
+        job.provenance = provenance;
+        submitExport(job);
     });
-    p->start();
-    cropper->showMessage("Beginning export");
+    cropper->showMessage("Exporting once doubling is done");
     fileList_chewTop();
     cropper_nextFile();
 }
 
+void MainWindow::submitExport(ExportJob &job)
+{
+    if (ui->spoolExport->isChecked()) {
+        // Hashed and copied into the spool off this thread; the outcome comes
+        // back in exportQueue_spooled().
+        exportQueue->spool(job, ui->spoolFolder->text());
+        return;
+    }
+    exportQueue->enqueue(job);
+    cropper->showMessage("Beginning export");
+}
+
+void MainWindow::cropper_exportGroup(QString sourceFilename, QSize workingSize,
+                                     ImageCropping transform)
+{
+    StallWatchdog::Scope stall("MainWindow::cropper_exportGroup");
+    ImageHeader framed;
+    if (!index->lookup(sourceFilename, &framed) || !framed.isValid()) {
+        cropper->showMessage("This file has not been probed yet");
+        return;
+    }
+    if (framed.orientation != 0) {
+        cropper->showMessage("Only files without an EXIF rotation can be grouped");
+        return;
+    }
+
+    // The translation is in output pixels, so only the scaling has to follow
+    // a member's size.  Members are exported from their sources as they are,
+    // even if the framed file was doubled.
+    qreal tolerance = ui->groupTolerance->value() / 100;
+    QSize reference = framed.size;
+    QList<GroupReview::Member> members;
+    for (int i = 0; i < ui->fileList->count(); i++) {
+        QString filename = ui->fileList->item(i)->text();
+        ImageHeader h;
+        if (filename == queueHead || !index->lookup(filename, &h)
+                || !h.isValid() || h.orientation != 0)
+            continue;
+        qreal kx = h.size.width() / qreal(reference.width());
+        qreal ky = h.size.height() / qreal(reference.height());
+        if (qAbs(kx - 1) > tolerance + 1e-9 || qAbs(ky - 1) > tolerance + 1e-9)
+            continue;
+        GroupReview::Member m;
+        m.filename = filename;
+        m.transform = transform;
+        m.transform.image = h.size;
+        m.transform.scaling *= std::sqrt(workingSize.width() / qreal(h.size.width())
+                                         * workingSize.height() / qreal(h.size.height()));
+        members << m;
+    }
+    if (members.isEmpty()) {
+        cropper->showMessage("No other queued file has this size");
+        return;
+    }
+
+    QSize size = cropper->emulatedSize();
+    QColor light = exportLight();
+    GroupReview *review = new GroupReview(members, size, light, cropper);
+    review->setAttribute(Qt::WA_DeleteOnClose);
+    connect(review, &QDialog::accepted, this, [this, review, size, light]() {
+        QSet<QString> queued = queuedFiles();
+        int count = 0;
+        for (const GroupReview::Member &m : review->accepted()) {
+            // Auto-crop may have taken a member while the review was open,
+            // or another operator taken it to crop by hand.
+            if (!queued.contains(m.filename))
+                continue;
+            if (sharingQueue() && !sharedQueue.claim(m.filename, operatorName))
+                continue;
+            ExportJob job;
+            job.sourceFilename = m.filename;
+            job.workingFilename = m.filename;
+            job.outputFilename = outputFilename(m.filename);
+            job.transform = m.transform;
+            job.size = size;
+            job.light = light.name();
+            submitExport(job);
+            if (sharingQueue()) {
+                claimedAhead.removeOne(m.filename);
+                sharedQueue.finish(m.filename, operatorName);
+            }
+            for (int i = 0; i < ui->fileList->count(); i++) {
+                if (ui->fileList->item(i)->text() == m.filename) {
+                    delete ui->fileList->takeItem(i);
+                    break;
+                }
+            }
+            count++;
+        }
+        grouped += count;
+        cropper->exportCurrent();
+        cropper->showMessage(QString("Exporting %1 more with the same framing")
+                             .arg(count));
+    });
+    review->open();
+}
+
+void MainWindow::exportQueue_spooled(ExportJob job, bool ok)
+{
+    StallWatchdog::Scope stall("MainWindow::exportQueue_spooled");
+    // Workers on other hosts may not see the same index, so the queue has
+    // already weeded out unchanged outputs before anything gets this far.
+    if (!ok) {
+        cropper->showMessage("Could not write to the spool, exporting here");
+        exportQueue->enqueue(job);
+        return;
+    }
+    // The spool holds its own copy of any working file.
+    if (job.sourceFilename != job.workingFilename)
+        ScratchManager::instance()->release(job.workingFilename);
+    cropper->showMessage("Queued for the export workers");
+    updateSpoolStatus();
+}
+
+void MainWindow::exportQueue_finished(ExportJob job, ExportQueue::Result result,
+                                      qint64 msecs, QString error)
+{
+    StallWatchdog::Scope stall("MainWindow::exportQueue_finished");
+    // A failed export keeps its working copy, doubled at some expense, until
+    // it is retried successfully or discarded.
+    if (result != ExportQueue::Failed && job.sourceFilename != job.workingFilename)
+        ScratchManager::instance()->release(job.workingFilename);
+    switch (result) {
+    case ExportQueue::Exported:
+        exportsDone++;
+        exportTime += msecs;
+        cropper->showMessage("Export finished");
+        break;
+    case ExportQueue::Failed:
+        exportsFailed++;
+        failedJobs << job;
+        ui->failedList->addItem(QString("%1: %2")
+                                .arg(QFileInfo(job.sourceFilename).fileName(), error));
+        updateFailedStatus();
+        cropper->showMessage("Export failed: " + error);
+        break;
+    case ExportQueue::Unchanged:
+        cropper->showMessage("Unchanged since the last export");
+        break;
+    }
+    emit fileExported(job.sourceFilename, job.outputFilename,
+                      result != ExportQueue::Failed, msecs);
+}
+
+void MainWindow::updateFailedStatus()
+{
+    bool any = !failedJobs.isEmpty();
+    ui->failedList->setVisible(any);
+    ui->failedStatus->setVisible(any);
+    ui->failedRetry->setVisible(any);
+    ui->failedDiscard->setVisible(any);
+    ui->failedStatus->setText(QString("%1 failed exports").arg(failedJobs.count()));
+}
+
+void MainWindow::on_failedRetry_clicked()
+{
+    QList<ExportJob> jobs = failedJobs;
+    failedJobs.clear();
+    ui->failedList->clear();
+    updateFailedStatus();
+    for (const ExportJob &job : jobs)
+        exportQueue->enqueue(job);
+}
+
+void MainWindow::on_failedDiscard_clicked()
+{
+    StallWatchdog::Scope stall("MainWindow::on_failedDiscard_clicked");
+    for (const ExportJob &job : failedJobs)
+        if (job.sourceFilename != job.workingFilename)
+            ScratchManager::instance()->release(job.workingFilename);
+    failedJobs.clear();
+    ui->failedList->clear();
+    updateFailedStatus();
+}
+
 void MainWindow::cropper_escape()
 {
     cropper->hide();
@@ -139,22 +584,34 @@ void MainWindow::cropper_escape()
 
 void MainWindow::cropper_skip()
 {
+    skipped++;
+    emit fileSkipped(queueHead);
     fileList_chewTop();
     cropper_nextFile();
 }
 
 void MainWindow::cropper_nextFile()
 {
+    StallWatchdog::Scope stall("MainWindow::cropper_nextFile");
     if (!cropper->isDone()) {
         cropper_show();
         return;
     }
+    if (sharingQueue())
+        claimAhead();
     if (ui->fileList->count() > 0) {
-        auto item = ui->fileList->item(0);
-        if (!item)
+        auto item = queueItem(0);
+        if (!item) {
+            if (sharingQueue())
+                cropper->showMessage("Everything left is claimed by other operators");
+            cropper->hide();
             return;
+        }
+        queueHead = item->text();
         cropper->setSource(item->text());
         cropper_show();
+        prefetchQueue();
+        updateFilmstrips();
     } else {
         cropper->hide();
     }
@@ -162,42 +619,98 @@ void MainWindow::cropper_nextFile()
 
 void MainWindow::cropper_show()
 {
-    QDesktopWidget *desktop = QApplication::desktop();
     QWidget *cropwin = cropper->window();
-    if (ui->fullscreen->isChecked()) {
-        QRect sg = desktop->screenGeometry(ui->fullscreenScreen->currentIndex());
-        cropwin->setGeometry(sg);
+    cropper->setDisplayScale(cropperScale());
+    QRect placement = cropperGeometry();
+    cropwin->setGeometry(placement);
+    if (ui->fullscreen->isChecked())
         cropwin->showFullScreen();
-        cropper->setEmulatedSize(sg.size());
-    } else {
-        qreal scale = ui->windowedSize->currentText().remove('%').toDouble()/100;
-        cropper->setDisplayScale(scale);
-        QRect available = desktop->screenGeometry(this);
-        QSize window = available.size() * scale;
-        QRect placement = QStyle::alignedRect(
-                    Qt::LeftToRight,
-                    Qt::AlignCenter,
-                    window,
-                    available
-                );
-        cropwin->setGeometry(placement);
-        cropper->setEmulatedSize(placement.size());
-    }
+    cropper->setEmulatedSize(exportSize());
     cropwin->show();
 }
 
+QRect MainWindow::cropperGeometry()
+{
+    QDesktopWidget *desktop = QApplication::desktop();
+    if (ui->fullscreen->isChecked())
+        return desktop->screenGeometry(ui->fullscreenScreen->currentIndex());
+    QRect available = desktop->screenGeometry(this);
+    QSize window = available.size() * cropperScale();
+    return QStyle::alignedRect(
+                Qt::LeftToRight,
+                Qt::AlignCenter,
+                window,
+                available
+            );
+}
+
+qreal MainWindow::cropperScale()
+{
+    if (ui->fullscreen->isChecked())
+        return 1.0;
+    return ui->windowedSize->currentText().remove('%').toDouble()/100;
+}
+
+QSize MainWindow::exportSize()
+{
+    // What the cropper emulates, and so what an export of it comes out at;
+    // anything framed without the cropper must use the same.
+    return cropper->emulatedSizeFor(cropperGeometry().size(), cropperScale());
+}
+
 void MainWindow::fileList_chewTop()
 {
-    auto item = ui->fileList->takeItem(0);
-    if (item)
-        delete item;
+    // The file being cropped, which is not necessarily the top row once the
+    // queue has been filtered or re-sorted in the meantime.
+    for (int i = 0; i < ui->fileList->count(); i++) {
+        if (ui->fileList->item(i)->text() == queueHead) {
+            delete ui->fileList->takeItem(i);
+            break;
+        }
+    }
+    if (claimedAhead.removeOne(queueHead))
+        sharedQueue.finish(queueHead, operatorName);
+    if (!queueHead.isEmpty()) {
+        history << queueHead;
+        while (history.count() > filmstripDepth)
+            history.removeFirst();
+    }
+    queueHead.clear();
+}
+
+void MainWindow::fileList_rowsInserted(const QModelIndex &parent, int first, int last)
+{
+    Q_UNUSED(parent);
+    if (sortingQueue)
+        return;
+    QStringList files;
+    for (int i = first; i <= last; i++) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        item->setData(SequenceRole, nextSequence++);
+        files << item->text();
+        emit fileQueued(item->text());
+    }
+    if (ui->skipExported->isChecked())
+        freshlyQueued += files;
+    index->probe(files);
+    annotateTimer.start();
 }
 
-void MainWindow::process_finished(QString fileToRemove)
+
+void MainWindow::watcher_filesReady(QStringList files)
 {
-    cropper->showMessage("Export finished");
-    if (!fileToRemove.isEmpty())
-        QFile(fileToRemove).remove();
+    StallWatchdog::Scope stall("MainWindow::watcher_filesReady");
+    QSet<QString> queued = queuedFiles();
+    for (const QString &file : files) {
+        if (queued.contains(file) || QFileInfo(outputFilename(file)).exists())
+            continue;
+        ui->fileList->addItem(file);
+        queued.insert(file);
+        // Arrivals near the head of the queue are decoded now; the rest are
+        // only probed by the index and decoded as the cropper approaches them.
+        if (ui->fileList->count() <= prefetchDepth + 1 && !sharingQueue())
+            prefetcher->prefetch(file);
+    }
 }
 
 
@@ -249,10 +762,31 @@ void MainWindow::loadSettings()
     LOAD_WIDGET(ui->singleFile, true, bool, Checked);
     LOAD_WIDGET(ui->batchFile, false, bool, Checked);
     LOAD_WIDGET(ui->folder, false, bool, Checked);
+    LOAD_WIDGET(ui->folderSettle, 2000, int, Value);
+    LOAD_WIDGET(ui->folderWatch, false, bool, Checked);
     LOAD_WIDGET(ui->otherFolder, true, bool, Checked);
     LOAD_WIDGET(ui->sameFolder, true, bool, Checked);
     LOAD_WIDGET(ui->fullscreen, true, bool, Checked);
     LOAD_WIDGET(ui->windowed, false, bool, Checked);
+    LOAD_WIDGET(ui->frameRateCap, 0, int, Value);
+    LOAD_WIDGET(ui->spoolFolder, QString(), QString, Text);
+    LOAD_WIDGET(ui->spoolExport, false, bool, Checked);
+    LOAD_WIDGET(ui->sharedQueueFolder, QString(), QString, Text);
+    LOAD_WIDGET(ui->sharedQueue, false, bool, Checked);
+    LOAD_WIDGET(ui->skipExported, false, bool, Checked);
+    LOAD_WIDGET(ui->exportJobs, qMax(1, QThread::idealThreadCount() / 2), int, Value);
+    LOAD_WIDGET(ui->autoCrop, false, bool, Checked);
+    LOAD_WIDGET(ui->autoCropTolerance, 1.0, double, Value);
+    LOAD_WIDGET(ui->groupTolerance, 0.0, double, Value);
+    LOAD_WIDGET(ui->childNice, 10, int, Value);
+    LOAD_WIDGET(ui->childIoClass, int(ProcessGovernor::IoBestEffort), int, CurrentIndex);
+    LOAD_WIDGET(ui->childThreads, 0, int, Value);
+    LOAD_WIDGET(ui->reserveCore, false, bool, Checked);
+    LOAD_WIDGET(ui->doubleRegion, true, bool, Checked);
+    LOAD_WIDGET(ui->queueFilter, 0, int, CurrentIndex);
+    LOAD_WIDGET(ui->scratchFolder, QString("/dev/shm"), QString, Text);
+    LOAD_WIDGET(ui->scratchQuota, 2048, int, Value);
+    LOAD_WIDGET(ui->memoryBudget, 4096, int, Value);
     LOAD_WIDGET(ui->waifu2xExecutable, QString(), QString, Text);
     LOAD_WIDGET(ui->waifu2xModelDir, QString(), QString, Text);
     checkFolders();
@@ -269,6 +803,8 @@ void MainWindow::loadSettings()
     LOAD_WIDGET(ui->resetRotationEdit, QKeySequence("2"), QKeySequence, KeySequence);
     LOAD_WIDGET(ui->resetLocationEdit, QKeySequence("3"), QKeySequence, KeySequence);
     LOAD_WIDGET(ui->showRulesEdit, QKeySequence("R"), QKeySequence, KeySequence);
+    LOAD_WIDGET(ui->showFilmstripEdit, QKeySequence("F"), QKeySequence, KeySequence);
+    LOAD_WIDGET(ui->exportGroupEdit, QKeySequence("G"), QKeySequence, KeySequence);
 
     LOAD_WIDGET_LIST(ui->fullscreenScreen, "1920x1080+0+0");
     LOAD_WIDGET_LIST(ui->windowedSize, "75%");
@@ -285,10 +821,31 @@ void MainWindow::saveSettings()
     SAVE_WIDGET(ui->singleFile, isChecked);
     SAVE_WIDGET(ui->batchFile, isChecked);
     SAVE_WIDGET(ui->folder, isChecked);
+    SAVE_WIDGET(ui->folderSettle, value);
+    SAVE_WIDGET(ui->folderWatch, isChecked);
     SAVE_WIDGET(ui->otherFolder, isChecked);
     SAVE_WIDGET(ui->sameFolder, isChecked);
     SAVE_WIDGET(ui->fullscreen, isChecked);
     SAVE_WIDGET(ui->windowed, isChecked);
+    SAVE_WIDGET(ui->frameRateCap, value);
+    SAVE_WIDGET(ui->spoolFolder, text);
+    SAVE_WIDGET(ui->spoolExport, isChecked);
+    SAVE_WIDGET(ui->sharedQueueFolder, text);
+    SAVE_WIDGET(ui->sharedQueue, isChecked);
+    SAVE_WIDGET(ui->skipExported, isChecked);
+    SAVE_WIDGET(ui->exportJobs, value);
+    SAVE_WIDGET(ui->autoCrop, isChecked);
+    SAVE_WIDGET(ui->autoCropTolerance, value);
+    SAVE_WIDGET(ui->groupTolerance, value);
+    SAVE_WIDGET(ui->childNice, value);
+    SAVE_WIDGET(ui->childIoClass, currentIndex);
+    SAVE_WIDGET(ui->childThreads, value);
+    SAVE_WIDGET(ui->reserveCore, isChecked);
+    SAVE_WIDGET(ui->doubleRegion, isChecked);
+    SAVE_WIDGET(ui->queueFilter, currentIndex);
+    SAVE_WIDGET(ui->scratchFolder, text);
+    SAVE_WIDGET(ui->scratchQuota, value);
+    SAVE_WIDGET(ui->memoryBudget, value);
     SAVE_WIDGET(ui->waifu2xExecutable, text);
     SAVE_WIDGET(ui->waifu2xModelDir, text);
     SAVE_WIDGET(ui->waifu2xProcessor, currentIndex);
@@ -303,6 +860,8 @@ void MainWindow::saveSettings()
     SAVE_WIDGET(ui->resetZoomEdit, keySequence);
     SAVE_WIDGET(ui->resetLocationEdit, keySequence);
     SAVE_WIDGET(ui->showRulesEdit, keySequence);
+    SAVE_WIDGET(ui->showFilmstripEdit, keySequence);
+    SAVE_WIDGET(ui->exportGroupEdit, keySequence);
 
     SAVE_WIDGET(ui->fullscreenScreen, currentText);
     SAVE_WIDGET(ui->windowedSize, currentText);
@@ -310,6 +869,7 @@ void MainWindow::saveSettings()
 
 void MainWindow::checkFolders()
 {
+    StallWatchdog::Scope stall("MainWindow::checkFolders");
     bool exec = cropper->setExecutable(ui->waifu2xExecutable->text());
     bool models = cropper->setModelDir(ui->waifu2xModelDir->text());
     static const char badStyle[] = "background: #ba8a8a; color: black;";
@@ -324,6 +884,35 @@ void MainWindow::checkFolders()
     ui->waifu2xProcessor->clear();
     ui->waifu2xProcessor->addItems(processors);
     ui->waifu2xProcessor->setCurrentIndex(oldIndex);
+    ui->waifu2xCalibrate->setEnabled(exec && models);
+
+    // Label each processor with its calibrated throughput, if there is one.
+    ProcessorCalibration::Results results;
+    if (!exec || !models
+            || !ProcessorCalibration::load(cropper->executablePath(),
+                                           cropper->modelDir(), &results)) {
+        ui->waifu2xCalibration->setText(exec && models ? "Not calibrated" : "");
+        return;
+    }
+    for (auto p = results.constBegin(); p != results.constEnd(); ++p) {
+        int item = p.key() + 1;
+        if (item >= ui->waifu2xProcessor->count())
+            continue;
+        QStringList perModel;
+        double sum = 0;
+        for (auto m = p.value().constBegin(); m != p.value().constEnd(); ++m) {
+            perModel << QString("%1: %2 MP/s").arg(m.key()).arg(m.value(), 0, 'f', 2);
+            sum += m.value();
+        }
+        double mean = p.value().isEmpty() ? 0 : sum / p.value().count();
+        ui->waifu2xProcessor->setItemText(item, QString("%1 (%2 MP/s)")
+                                          .arg(ui->waifu2xProcessor->itemText(item))
+                                          .arg(mean, 0, 'f', 2));
+        ui->waifu2xProcessor->setItemData(item, perModel.join('\n'), Qt::ToolTipRole);
+    }
+    int best = ProcessorCalibration::fastest(results);
+    ui->waifu2xCalibration->setText(best < 0 ? QString("No processor worked")
+            : QString("Fastest is processor %1").arg(best));
 }
 
 void MainWindow::updateActions()
@@ -337,8 +926,355 @@ void MainWindow::updateActions()
     cropper->setShowRulesShortcut(ui->showRulesEdit->keySequence());
 }
 
+void MainWindow::updateBudgetStatus()
+{
+    MemoryBudget *budget = MemoryBudget::instance();
+    ui->budgetStatus->setText(QString("Memory: %1 / %2 MiB, %3 evictions")
+                              .arg(budget->usage() >> 20)
+                              .arg(budget->budget() >> 20)
+                              .arg(budget->evictions()));
+}
+
+void MainWindow::updateScratchStatus()
+{
+    ScratchManager *scratch = ScratchManager::instance();
+    ui->scratchStatus->setText(QString("Scratch: %1 / %2 MiB")
+                               .arg(scratch->usage() >> 20)
+                               .arg(scratch->quota() >> 20));
+}
+
+void MainWindow::updateSpoolStatus()
+{
+    StallWatchdog::Scope stall("MainWindow::updateSpoolStatus");
+    if (!ui->spoolExport->isChecked()) {
+        ui->spoolStatus->clear();
+        return;
+    }
+    // Counted off this thread; the answer comes back through polled().
+    spoolMonitor->poll(ui->spoolFolder->text());
+}
+
+void MainWindow::updateSharedQueue()
+{
+    StallWatchdog::Scope stall("MainWindow::updateSharedQueue");
+    if (!sharingQueue())
+        return;
+    QJsonObject state;
+    state["current"] = queueHead;
+    state["holding"] = claimedAhead.count();
+    sharedQueue.heartbeat(operatorName, state);
+    sharedQueue.expireStale(leaseExpiry);
+    ui->sharedQueueStatus->setText(QString("Shared: %1 claimed, %2 done, %3 operators")
+                                   .arg(sharedQueue.claimed())
+                                   .arg(sharedQueue.done())
+                                   .arg(sharedQueue.operators(leaseExpiry).count()));
+}
+
+QString MainWindow::outputFilename(const QString &sourceFilename)
+{
+    QFileInfo info(sourceFilename);
+    QString appendage = "_cropped.png";
+    return QString("%1/%2%3")
+            .arg(ui->sameFolder->isChecked() ? info.absolutePath()
+                                             : ui->otherFolderText->text())
+            .arg(info.completeBaseName().left(255 - appendage.length()))
+            .arg(appendage);
+}
+
+QSet<QString> MainWindow::queuedFiles()
+{
+    QSet<QString> files;
+    for (int i = 0; i < ui->fileList->count(); i++)
+        files.insert(ui->fileList->item(i)->text());
+    return files;
+}
+
+void MainWindow::prefetchQueue()
+{
+    for (int i = 1; i <= prefetchDepth; i++)
+        if (QListWidgetItem *item = queueItem(i))
+            prefetcher->prefetch(item->text());
+}
+
+void MainWindow::dropExported()
+{
+    StallWatchdog::Scope stall("MainWindow::dropExported");
+    if (freshlyQueued.isEmpty())
+        return;
+    QSet<QString> fresh = freshlyQueued.toSet();
+    freshlyQueued.clear();
+    QSize size = exportSize();
+    QColor light = exportLight();
+    for (int i = ui->fileList->count() - 1; i >= 0; i--) {
+        QString file = ui->fileList->item(i)->text();
+        if (!fresh.contains(file) || file == queueHead)
+            continue;
+        QString outfile = outputFilename(file);
+        if (ExportIndex::forFolder(QFileInfo(outfile).absolutePath())
+                ->isExported(file, outfile, size, light.name()))
+            delete ui->fileList->takeItem(i);
+    }
+}
+
+QColor MainWindow::exportLight()
+{
+    QColor light(ui->lightColor->text());
+    return light.isValid() ? light : QColor("#FFFFFF");
+}
+
+void MainWindow::updateFilmstrips()
+{
+    QStringList next;
+    for (int i = 1; i <= filmstripDepth; i++)
+        if (QListWidgetItem *item = queueItem(i))
+            next << item->text();
+    cropper->setFilmstrip(history, queueHead, next);
+
+    // The dialog's strip follows the selection, or the head of the queue.
+    int row = qMax(0, ui->fileList->currentRow());
+    QStringList before, after;
+    QString current;
+    for (int i = row - 1; i >= 0 && before.count() < filmstripDepth; i--)
+        if (!ui->fileList->item(i)->isHidden())
+            before.prepend(ui->fileList->item(i)->text());
+    if (row < ui->fileList->count())
+        current = ui->fileList->item(row)->text();
+    for (int i = row + 1; i < ui->fileList->count() && after.count() < filmstripDepth; i++)
+        if (!ui->fileList->item(i)->isHidden())
+            after << ui->fileList->item(i)->text();
+    ui->filmstrip->setFiles(before, current, after);
+}
+
+QListWidgetItem *MainWindow::queueItem(int n)
+{
+    // With a shared queue the cropper, the prefetcher and the filmstrip only
+    // look at what this instance holds.
+    bool shared = sharingQueue();
+    for (int i = 0; i < ui->fileList->count(); i++) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        if (item->isHidden() || (shared && !claimedAhead.contains(item->text())))
+            continue;
+        if (n-- == 0)
+            return item;
+    }
+    return NULL;
+}
+
+bool MainWindow::sharingQueue() const
+{
+    return !sharedQueue.folder().isEmpty();
+}
+
+void MainWindow::joinSharedQueue()
+{
+    QString folder = ui->sharedQueueFolder->text();
+    if (folder == sharedQueue.folder())
+        return;
+    leaveSharedQueue();
+    sharedQueue.setFolder(folder);
+    if (!sharedQueue.create()) {
+        sharedQueue.setFolder(QString());
+        ui->sharedQueueStatus->setText("Could not use the shared queue");
+        return;
+    }
+    // The heartbeat goes down before any claim; others expire leases whose
+    // owner has none.
+    updateSharedQueue();
+    sharedQueueTimer.start();
+}
+
+void MainWindow::leaveSharedQueue()
+{
+    sharedQueueTimer.stop();
+    if (!sharingQueue())
+        return;
+    // The file on screen is given back too; whoever claims it next starts
+    // its framing afresh.
+    sharedQueue.retire(operatorName);
+    sharedQueue.setFolder(QString());
+    claimedAhead.clear();
+    ui->sharedQueueStatus->clear();
+}
+
+void MainWindow::claimAhead()
+{
+    StallWatchdog::Scope stall("MainWindow::claimAhead");
+    // Leases on files that have left the queue or been filtered out of it
+    // are given back, except on the one being cropped.
+    for (int i = claimedAhead.count() - 1; i >= 0; i--) {
+        QString file = claimedAhead[i];
+        QList<QListWidgetItem *> items = ui->fileList->findItems(file, Qt::MatchExactly);
+        if (file != queueHead && (items.isEmpty() || items.first()->isHidden())) {
+            sharedQueue.release(file, operatorName);
+            claimedAhead.removeAt(i);
+        }
+    }
+    // Then enough of the queue is claimed for the file on screen and those
+    // the prefetcher decodes behind it.
+    for (int i = 0; i < ui->fileList->count() && claimedAhead.count() <= prefetchDepth;) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        QString file = item->text();
+        if (item->isHidden() || claimedAhead.contains(file)) {
+            i++;
+            continue;
+        }
+        if (sharedQueue.isDone(file)) {
+            delete ui->fileList->takeItem(i);
+            continue;
+        }
+        if (sharedQueue.claim(file, operatorName))
+            claimedAhead << file;
+        i++;
+    }
+}
+
+bool MainWindow::needsDoubling(const ImageHeader &header)
+{
+    QSize target = exportSize();
+    QSize size = header.displaySize();
+    return size.width() < target.width() || size.height() < target.height();
+}
+
+void MainWindow::annotateQueue()
+{
+    StallWatchdog::Scope stall("MainWindow::annotateQueue");
+    dropExported();
+    if (cropper->isVisible())
+        autoCropQueue();
+    int filter = ui->queueFilter->currentIndex();
+    int known = 0;
+    for (int i = 0; i < ui->fileList->count(); i++) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        ImageHeader h;
+        if (!index->lookup(item->text(), &h) || !h.isValid()) {
+            item->setHidden(filter != FilterAll);
+            continue;
+        }
+        known++;
+        bool doubling = needsDoubling(h);
+        QSize size = h.displaySize();
+        item->setToolTip(QString("%1x%2, %3, %4-bit%5")
+                         .arg(size.width()).arg(size.height())
+                         .arg(QString::fromLatin1(h.format).toUpper())
+                         .arg(h.depth)
+                         .arg(doubling ? ", needs doubling" : ""));
+        item->setHidden((filter == FilterNeedsDoubling && !doubling)
+                        || (filter == FilterNoDoubling && doubling));
+    }
+    updateFilmstrips();
+    QString status = index->pending() > 0
+            ? QString("Probing %1 files").arg(index->pending())
+            : QString("%1 of %2 probed").arg(known).arg(ui->fileList->count());
+    if (autoCropped > 0)
+        status += QString("; %1 auto-cropped").arg(autoCropped);
+    ui->queueStatus->setText(status);
+}
+
+void MainWindow::autoCropQueue()
+{
+    StallWatchdog::Scope stall("MainWindow::autoCropQueue");
+    if (!ui->autoCrop->isChecked())
+        return;
+    // Images already the screen's shape and no smaller than it would only be
+    // fitted and exported by hand, so they are framed here without ever being
+    // shown.  Anything rotated by its EXIF tag is left alone, since convert
+    // works on the stored pixels.
+    QSize target = exportSize();
+    qreal targetAspect = qreal(target.width()) / target.height();
+    qreal tolerance = ui->autoCropTolerance->value() / 100;
+    QColor light = exportLight();
+    int cropped = 0;
+    for (int i = 0; i < ui->fileList->count();) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        ImageHeader h;
+        if (item->text() == queueHead || !index->lookup(item->text(), &h)
+                || !h.isValid() || h.orientation != 0 || needsDoubling(h)) {
+            i++;
+            continue;
+        }
+        qreal aspect = qreal(h.size.width()) / h.size.height();
+        if (qAbs(aspect / targetAspect - 1) > tolerance) {
+            i++;
+            continue;
+        }
+        if (sharingQueue() && !sharedQueue.claim(item->text(), operatorName)) {
+            i++;
+            continue;
+        }
+
+        // Fit whichever side leaves no border; the other is cropped evenly.
+        ExportJob job;
+        job.sourceFilename = item->text();
+        job.workingFilename = item->text();
+        job.outputFilename = outputFilename(item->text());
+        job.transform = ImageCropping::fromSize(h.size);
+        job.transform.image = h.size;
+        job.transform.scaling = qMax(target.width() / qreal(h.size.width()),
+                                     target.height() / qreal(h.size.height()));
+        job.size = target;
+        job.light = light.name();
+        submitExport(job);
+        if (sharingQueue()) {
+            claimedAhead.removeOne(item->text());
+            sharedQueue.finish(item->text(), operatorName);
+        }
+        delete ui->fileList->takeItem(i);
+        cropped++;
+    }
+    if (cropped == 0)
+        return;
+    autoCropped += cropped;
+    cropper->showMessage(QString("Auto-cropped %1 files, %2 left to frame")
+                         .arg(cropped).arg(ui->fileList->count()));
+}
+
+void MainWindow::sortQueue()
+{
+    StallWatchdog::Scope stall("MainWindow::sortQueue");
+    int order = ui->queueSort->currentIndex();
+    auto pixels = [this](QListWidgetItem *item) -> qint64 {
+        ImageHeader h;
+        if (!index->lookup(item->text(), &h) || !h.isValid())
+            return -1;
+        return qint64(h.size.width()) * h.size.height();
+    };
+    auto doubling = [this](QListWidgetItem *item) {
+        ImageHeader h;
+        return index->lookup(item->text(), &h) && h.isValid() && needsDoubling(h);
+    };
+
+    // Keys are computed once; files not probed yet keep their place at the end.
+    struct Entry { QListWidgetItem *item; qint64 key; int sequence; };
+    QVector<Entry> entries;
+    for (int i = 0; i < ui->fileList->count(); i++) {
+        QListWidgetItem *item = ui->fileList->item(i);
+        qint64 key = 0;
+        if (order == SortLargestFirst || order == SortSmallestFirst) {
+            qint64 p = pixels(item);
+            key = p < 0 ? std::numeric_limits<qint64>::max()
+                        : order == SortLargestFirst ? -p : p;
+        } else if (order == SortNeedsDoublingFirst) {
+            key = doubling(item) ? 0 : 1;
+        }
+        entries.append({ item, key, item->data(SequenceRole).toInt() });
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const Entry &a, const Entry &b) {
+        return a.key != b.key ? a.key < b.key : a.sequence < b.sequence;
+    });
+
+    sortingQueue = true;
+    while (ui->fileList->count() > 0)
+        ui->fileList->takeItem(0);
+    for (const Entry &e : entries)
+        ui->fileList->addItem(e.item);
+    sortingQueue = false;
+    annotateQueue();
+}
+
 void MainWindow::importBatchFile(QString fileName)
 {
+    StallWatchdog::Scope stall("MainWindow::importBatchFile");
     QFile f(fileName);
     if (!f.open(QFile::ReadOnly | QFile::Text))
         return;
@@ -348,6 +1284,7 @@ void MainWindow::importBatchFile(QString fileName)
 
 void MainWindow::exportBatchFile(QString fileName)
 {
+    StallWatchdog::Scope stall("MainWindow::exportBatchFile");
     QFile f(fileName);
     if (!f.open(QFile::ReadWrite | QFile::Truncate | QFile::Text))
         return;
@@ -431,8 +1368,20 @@ void MainWindow::on_showRulesReset_clicked()
     ui->showRulesEdit->clear();
 }
 
+void MainWindow::on_showFilmstripReset_clicked()
+{
+    ui->showFilmstripEdit->clear();
+}
+
+void MainWindow::on_exportGroupReset_clicked()
+{
+    ui->exportGroupEdit->clear();
+}
+
 void MainWindow::on_start_clicked()
 {
+    autoCropQueue();
+    annotateQueue();
     cropper_nextFile();
 }
 
@@ -455,6 +1404,7 @@ void MainWindow::on_batchFileSend_clicked()
 
 void MainWindow::on_folderSend_clicked()
 {
+    StallWatchdog::Scope stall("MainWindow::on_folderSend_clicked");
     QString dirText = ui->folderText->text();
     if (!dirText.endsWith("/"))
         dirText += "/";
@@ -462,8 +1412,10 @@ void MainWindow::on_folderSend_clicked()
     QFileInfoList l = d.entryInfoList({"*.png","*.jpg","*.jpeg"}, QDir::Files | QDir::NoDotAndDotDot);
     if (l.isEmpty())
         return;
+    QSet<QString> queued = queuedFiles();
     for (const QFileInfo &info : l)
-        ui->fileList->addItem(info.absoluteFilePath());
+        if (!queued.contains(info.absoluteFilePath()))
+            ui->fileList->addItem(info.absoluteFilePath());
 }
 
 void MainWindow::on_listImport_clicked()
@@ -512,3 +1464,70 @@ void MainWindow::on_waifu2xProcessor_currentIndexChanged(int index)
 {
     cropper->setProcessor(index - 1);
 }
+
+void MainWindow::on_waifu2xCalibrate_clicked()
+{
+    if (calibration->isRunning()) {
+        calibration->cancel();
+        ProcessorCalibration::decline(cropper->executablePath(), cropper->modelDir());
+        ui->waifu2xCalibrate->setText("Calibrate");
+        ui->waifu2xCalibration->setText("Calibration cancelled");
+        return;
+    }
+    ui->waifu2xCalibrate->setText("Cancel");
+    calibration->start(cropper->executablePath(), cropper->modelDir(),
+                       ui->waifu2xProcessor->count() - 1);
+}
+
+void MainWindow::calibration_finished(bool ok)
+{
+    ui->waifu2xCalibrate->setText("Calibrate");
+    if (!ok) {
+        ui->waifu2xCalibration->setText("Could not write the calibration tile");
+        return;
+    }
+    checkFolders();
+    int best = ProcessorCalibration::fastest(calibration->results());
+    if (best >= 0)
+        ui->waifu2xProcessor->setCurrentIndex(best + 1);
+}
+
+void MainWindow::on_spoolExport_toggled(bool checked)
+{
+    if (checked)
+        spoolTimer.start();
+    else
+        spoolTimer.stop();
+    updateSpoolStatus();
+}
+
+void MainWindow::on_spoolFolderBrowse_clicked()
+{
+    QString m = QFileDialog::getExistingDirectory(this, "Select Folder");
+    if (m.isNull())
+        return;
+    ui->spoolFolder->setText(m);
+}
+
+void MainWindow::on_sharedQueue_toggled(bool checked)
+{
+    if (checked)
+        joinSharedQueue();
+    else
+        leaveSharedQueue();
+}
+
+void MainWindow::on_sharedQueueFolderBrowse_clicked()
+{
+    QString m = QFileDialog::getExistingDirectory(this, "Select Folder");
+    if (m.isNull())
+        return;
+    ui->sharedQueueFolder->setText(m);
+    if (ui->sharedQueue->isChecked())
+        joinSharedQueue();
+}
+
+void MainWindow::on_folderWatch_toggled(bool checked)
+{
+    watcher->setFolder(checked ? ui->folderText->text() : QString());
+}
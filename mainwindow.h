@@ -1,8 +1,25 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QElapsedTimer>
+#include <QJsonObject>
 #include <QMainWindow>
+#include <QSet>
+#include <QTimer>
 #include "imagewindow.h"
+#include "exportspool.h"
+#include "exportqueue.h"
+#include "sharedqueue.h"
+
+class SessionRecorder;
+class FolderWatcher;
+class ImagePrefetcher;
+class ImageIndex;
+class ProcessorCalibration;
+class SpoolMonitor;
+class DeferredExport;
+struct ImageHeader;
+class QListWidgetItem;
 
 namespace Ui {
 class MainWindow;
@@ -15,17 +32,39 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
+    void setRecorder(SessionRecorder *recorder);
+    int enqueue(const QStringList &files);
+    QStringList queue(int offset, int limit);
+    QJsonObject status();
+
+signals:
+    void fileQueued(QString filename);
+    void fileSkipped(QString filename);
+    void fileExported(QString sourceFilename, QString outputFilename,
+                      bool ok, qint64 msecs);
+    void fileDoubled(QString sourceFilename, bool ok);
 
 private slots:
     void cropper_export(QString sourceFilename,
                         QString workingFilename,
                         ImageCropping transform);
+    void cropper_exportGroup(QString sourceFilename, QSize workingSize,
+                             ImageCropping transform);
+    void cropper_exportAfterDoubling(DeferredExport *pending);
     void cropper_escape();
     void cropper_skip();
     void cropper_nextFile();
     void cropper_show();
     void fileList_chewTop();
-    void process_finished(QString fileToRemove);
+    void exportQueue_finished(ExportJob job, ExportQueue::Result result,
+                              qint64 msecs, QString error);
+    void exportQueue_spooled(ExportJob job, bool ok);
+    void watcher_filesReady(QStringList files);
+    void fileList_rowsInserted(const QModelIndex &parent, int first, int last);
+    void annotateQueue();
+    void sortQueue();
+    void autoCropQueue();
+    void updateFilmstrips();
 
     void on_singleFileBrowse_clicked();
     void on_batchFileBrowse_clicked();
@@ -39,6 +78,8 @@ private slots:
     void on_noiseReset_clicked();
     void on_multiplyReset_clicked();
     void on_showRulesReset_clicked();
+    void on_showFilmstripReset_clicked();
+    void on_exportGroupReset_clicked();
 
     void on_start_clicked();
     void on_stop_clicked();
@@ -58,6 +99,20 @@ private slots:
 
     void on_waifu2xProcessor_currentIndexChanged(int index);
 
+    void on_waifu2xCalibrate_clicked();
+    void calibration_finished(bool ok);
+
+    void on_folderWatch_toggled(bool checked);
+
+    void on_spoolExport_toggled(bool checked);
+    void on_spoolFolderBrowse_clicked();
+
+    void on_sharedQueue_toggled(bool checked);
+    void on_sharedQueueFolderBrowse_clicked();
+
+    void on_failedRetry_clicked();
+    void on_failedDiscard_clicked();
+
 protected:
     void dragEnterEvent(QDragEnterEvent *event);
     void dropEvent(QDropEvent *event);
@@ -68,11 +123,58 @@ private:
     void saveSettings();
     void checkFolders();
     void updateActions();
+    void updateBudgetStatus();
+    void updateScratchStatus();
+    void updateSpoolStatus();
+    void updateSharedQueue();
+    void updateFailedStatus();
     void importBatchFile(QString fileName);
     void exportBatchFile(QString fileName);
+    QString outputFilename(const QString &sourceFilename);
+    QSet<QString> queuedFiles();
+    void prefetchQueue();
+    QListWidgetItem *queueItem(int n);
+    bool sharingQueue() const;
+    void joinSharedQueue();
+    void leaveSharedQueue();
+    void claimAhead();
+    QRect cropperGeometry();
+    qreal cropperScale();
+    QSize exportSize();
+    bool needsDoubling(const ImageHeader &header);
+    void dropExported();
+    QColor exportLight();
+    void submitExport(ExportJob &job);
 
     Ui::MainWindow *ui;
     ImageWindow *cropper;
+    FolderWatcher *watcher;
+    ImagePrefetcher *prefetcher;
+    ImageIndex *index;
+    ExportQueue *exportQueue;
+    ProcessorCalibration *calibration;
+    QTimer annotateTimer;
+    QString queueHead;
+    QStringList history;
+    QStringList freshlyQueued;
+    int nextSequence;
+    bool sortingQueue;
+    QElapsedTimer sessionTimer;
+    int exportsDone;
+    int exportsFailed;
+    int exportRetries;
+    int deferredExports;
+    QList<ExportJob> failedJobs;
+    int skipped;
+    int autoCropped;
+    int grouped;
+    qint64 exportTime;
+    SpoolMonitor *spoolMonitor;
+    QTimer spoolTimer;
+    SharedQueue sharedQueue;
+    QTimer sharedQueueTimer;
+    QString operatorName;
+    QStringList claimedAhead;
 };
 
 #endif // MAINWINDOW_H
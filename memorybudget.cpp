@@ -0,0 +1,122 @@
+#include "memorybudget.h"
+
+MemoryBudget *MemoryBudget::instance()
+{
+    static MemoryBudget budget;
+    return &budget;
+}
+
+MemoryBudget::MemoryBudget()
+    : budget_(qint64(4096) << 20), usage_(0), evictions_(0), nextId(1),
+      useCounter(0), enforcing(false)
+{
+}
+
+void MemoryBudget::setBudget(qint64 bytes)
+{
+    budget_ = bytes;
+    enforce();
+    emit changed();
+}
+
+qint64 MemoryBudget::budget() const
+{
+    return budget_;
+}
+
+qint64 MemoryBudget::usage() const
+{
+    return usage_;
+}
+
+qint64 MemoryBudget::available() const
+{
+    return qMax<qint64>(0, budget_ - usage_);
+}
+
+int MemoryBudget::evictions() const
+{
+    return evictions_;
+}
+
+int MemoryBudget::add(const QString &label, Priority priority,
+                      std::function<void()> evict)
+{
+    Entry e;
+    e.label = label;
+    e.priority = priority;
+    e.bytes = 0;
+    e.lastUse = ++useCounter;
+    e.evict = evict;
+    entries.insert(nextId, e);
+    return nextId++;
+}
+
+void MemoryBudget::remove(int id)
+{
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    usage_ -= it->bytes;
+    entries.erase(it);
+    emit changed();
+}
+
+void MemoryBudget::resize(int id, qint64 bytes)
+{
+    auto it = entries.find(id);
+    if (it == entries.end() || it->bytes == bytes)
+        return;
+    usage_ += bytes - it->bytes;
+    it->bytes = bytes;
+    it->lastUse = ++useCounter;
+    enforce();
+    emit changed();
+}
+
+void MemoryBudget::touch(int id)
+{
+    auto it = entries.find(id);
+    if (it != entries.end())
+        it->lastUse = ++useCounter;
+}
+
+void MemoryBudget::setPriority(int id, Priority priority)
+{
+    auto it = entries.find(id);
+    if (it == entries.end())
+        return;
+    it->priority = priority;
+    enforce();
+}
+
+void MemoryBudget::enforce()
+{
+    // Evict callbacks usually resize their own entry, which lands back here.
+    if (enforcing)
+        return;
+    enforcing = true;
+    while (usage_ > budget_) {
+        auto victim = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->priority == Current || !it->evict || it->bytes == 0)
+                continue;
+            if (victim == entries.end()
+                    || it->priority < victim->priority
+                    || (it->priority == victim->priority
+                        && it->lastUse < victim->lastUse))
+                victim = it;
+        }
+        if (victim == entries.end())
+            break;
+        int id = victim.key();
+        victim->evict();
+        evictions_++;
+        auto it = entries.find(id);
+        if (it != entries.end()) {
+            usage_ -= it->bytes;
+            it->bytes = 0;
+        }
+    }
+    enforcing = false;
+}
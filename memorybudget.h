@@ -0,0 +1,58 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <functional>
+#include <QHash>
+#include <QObject>
+
+// Central account of the decoded images and working copies the program holds.
+// Holders register what they keep and how to drop it; when the total goes over
+// budget, the least important and least recently used entries are evicted.
+// Everything here is meant to be called from the GUI thread.
+class MemoryBudget : public QObject {
+    Q_OBJECT
+public:
+    // In eviction order.  Working buffers are rebuilt from what is already in
+    // memory on the next frame, so they go before caches that cost a decode.
+    enum Priority { Speculative, Working, Cached, Current };
+
+    static MemoryBudget *instance();
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    qint64 usage() const;
+    qint64 available() const;
+    int evictions() const;
+
+    int add(const QString &label, Priority priority,
+            std::function<void()> evict = std::function<void()>());
+    void remove(int id);
+    void resize(int id, qint64 bytes);
+    void touch(int id);
+    void setPriority(int id, Priority priority);
+
+signals:
+    void changed();
+
+private:
+    struct Entry {
+        QString label;
+        Priority priority;
+        qint64 bytes;
+        quint64 lastUse;
+        std::function<void()> evict;
+    };
+
+    MemoryBudget();
+    void enforce();
+
+    QHash<int, Entry> entries;
+    qint64 budget_;
+    qint64 usage_;
+    int evictions_;
+    int nextId;
+    quint64 useCounter;
+    bool enforcing;
+};
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,189 @@
+#include <QDir>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QThread>
+#include "processgovernor.h"
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// From linux/ioprio.h, which glibc does not wrap.
+static const int IoprioWhoProcess = 1;
+static const int IoprioClassShift = 13;
+static const int IoprioClassBestEffort = 2;
+static const int IoprioClassIdle = 3;
+#endif
+
+// How long input has to stop before the children get their cores back.
+static const int quietMsecs = 1500;
+
+class GovernedProcess : public QProcess {
+public:
+    GovernedProcess(QObject *parent) : QProcess(parent) {}
+
+protected:
+    void setupChildProcess()
+    {
+        ProcessGovernor::instance()->setupChild();
+    }
+};
+
+
+
+ProcessGovernor *ProcessGovernor::instance()
+{
+    static ProcessGovernor governor;
+    return &governor;
+}
+
+ProcessGovernor::ProcessGovernor()
+    : nice(10), ioClass(IoBestEffort), threads(0), reserveCore(false),
+      interacting(false), childIoPriority(0), childCpuCount(0)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++)
+            if (CPU_ISSET(i, &set))
+                cpus << i;
+    }
+#endif
+    quietTimer.setSingleShot(true);
+    quietTimer.setInterval(quietMsecs);
+    connect(&quietTimer, &QTimer::timeout, this, &ProcessGovernor::quiet);
+    update();
+}
+
+void ProcessGovernor::setNice(int nice)
+{
+    this->nice = qBound(0, nice, 19);
+}
+
+void ProcessGovernor::setIoClass(IoClass ioClass)
+{
+    this->ioClass = ioClass;
+    update();
+}
+
+void ProcessGovernor::setThreadLimit(int threads)
+{
+    this->threads = qMax(0, threads);
+}
+
+void ProcessGovernor::setReserveCore(bool reserve)
+{
+    reserveCore = reserve;
+    update();
+}
+
+int ProcessGovernor::threadLimit() const
+{
+    // Left at 0, the children share whatever the GUI does not keep for itself.
+    if (threads > 0)
+        return threads;
+    int cores = cpus.isEmpty() ? QThread::idealThreadCount() : cpus.count();
+    return qMax(1, cores - (reserveCore ? 1 : 0));
+}
+
+bool ProcessGovernor::isInteracting() const
+{
+    return interacting;
+}
+
+QProcess *ProcessGovernor::create(QObject *parent)
+{
+    QProcess *p = new GovernedProcess(parent);
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    QString limit = QString::number(threadLimit());
+    env.insert("OMP_NUM_THREADS", limit);
+    env.insert("MAGICK_THREAD_LIMIT", limit);
+    p->setProcessEnvironment(env);
+    children.insert(p);
+    connect(p, &QObject::destroyed, this, [this, p]() {
+        children.remove(p);
+    });
+    return p;
+}
+
+void ProcessGovernor::interacted()
+{
+    quietTimer.start();
+    if (interacting)
+        return;
+    interacting = true;
+    update();
+    emit interactingChanged(true);
+}
+
+void ProcessGovernor::quiet()
+{
+    interacting = false;
+    update();
+    emit interactingChanged(false);
+}
+
+void ProcessGovernor::update()
+{
+#ifdef Q_OS_LINUX
+    // Class 0 lets the kernel derive the I/O priority from the niceness.
+    if (interacting || ioClass == IoIdle)
+        childIoPriority = IoprioClassIdle << IoprioClassShift;
+    else if (ioClass == IoBestEffort)
+        childIoPriority = (IoprioClassBestEffort << IoprioClassShift) | 7;
+    else
+        childIoPriority = 0;
+
+    // The GUI thread is free to run anywhere; keeping the last core clear of
+    // the children is enough for the scheduler to put it there.
+    childCpuCount = 0;
+    int usable = cpus.count() - (interacting && reserveCore && cpus.count() > 1 ? 1 : 0);
+    for (int i = 0; i < usable && childCpuCount < 1024; i++)
+        childCpus[childCpuCount++] = cpus[i];
+
+    for (QProcess *p : children)
+        if (p->state() == QProcess::Running)
+            apply(p->processId());
+#endif
+}
+
+void ProcessGovernor::apply(qint64 pid)
+{
+#ifdef Q_OS_LINUX
+    // Affinity and I/O class are per thread, and the tools start their
+    // threads long before the operator next touches anything.  Niceness is
+    // left as it was set at start, since an unprivileged process may not lower
+    // it again once the operator lets go.
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < childCpuCount; i++)
+        CPU_SET(childCpus[i], &set);
+    QDir tasks(QString("/proc/%1/task").arg(pid));
+    for (const QString &tid : tasks.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        pid_t t = tid.toInt();
+        if (childCpuCount > 0)
+            sched_setaffinity(t, sizeof(set), &set);
+        syscall(SYS_ioprio_set, IoprioWhoProcess, t, childIoPriority);
+    }
+#else
+    Q_UNUSED(pid);
+#endif
+}
+
+void ProcessGovernor::setupChild()
+{
+#ifdef Q_OS_LINUX
+    // Between fork and exec: system calls on plain members only.
+    setpriority(PRIO_PROCESS, 0, nice);
+    syscall(SYS_ioprio_set, IoprioWhoProcess, 0, childIoPriority);
+    if (childCpuCount > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < childCpuCount; i++)
+            CPU_SET(childCpus[i], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef PROCESSGOVERNOR_H
+#define PROCESSGOVERNOR_H
+
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+class QProcess;
+
+// Keeps the external tools out of the editor's way.  Children are started
+// below the GUI's priority, in a lower I/O class and with a cap on their
+// threads.  While the operator is working in the cropper they are also kept
+// off a core reserved for the GUI and moved to the idle I/O class, and let
+// back once input has been quiet for a moment.  Everything here is meant to
+// be called from the GUI thread.
+class ProcessGovernor : public QObject {
+    Q_OBJECT
+public:
+    enum IoClass { IoUnchanged, IoBestEffort, IoIdle };
+
+    static ProcessGovernor *instance();
+
+    void setNice(int nice);
+    void setIoClass(IoClass ioClass);
+    void setThreadLimit(int threads);
+    void setReserveCore(bool reserve);
+    int threadLimit() const;
+    bool isInteracting() const;
+
+    QProcess *create(QObject *parent = 0);
+    void interacted();
+    void setupChild();
+
+signals:
+    void interactingChanged(bool interacting);
+
+private slots:
+    void quiet();
+
+private:
+    ProcessGovernor();
+    void update();
+    void apply(qint64 pid);
+
+    int nice;
+    IoClass ioClass;
+    int threads;
+    bool reserveCore;
+    bool interacting;
+    QList<int> cpus;
+    QSet<QProcess*> children;
+    QTimer quietTimer;
+
+    // Worked out ahead of time for setupChild(), which runs between fork and
+    // exec and must not allocate.
+    int childIoPriority;
+    int childCpuCount;
+    int childCpus[1024];
+};
+
+#endif // PROCESSGOVERNOR_H
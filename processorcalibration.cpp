@@ -0,0 +1,255 @@
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPair>
+#include <QProcess>
+#include <QSettings>
+#include <QSysInfo>
+#include <QTimer>
+#include "processgovernor.h"
+#include "processorcalibration.h"
+
+// The standard tile.  Large enough that the work outweighs starting the
+// processor, which still counts, as it does for every real doubling.
+static const int tileSize = 1024;
+
+ProcessorCalibration::ProcessorCalibration(QObject *parent)
+    : QObject(parent), total(0), scratch(0), process(0), disturbed(false)
+{
+    // Runs wait for the operator to stop, and one the operator got in the way
+    // of is timed again.
+    connect(ProcessGovernor::instance(), &ProcessGovernor::interactingChanged,
+            this, [this](bool interacting) {
+        if (interacting)
+            disturbed = process != 0;
+        else if (isRunning() && !process)
+            runNext();
+    });
+}
+
+ProcessorCalibration::~ProcessorCalibration()
+{
+    cancel();
+}
+
+void ProcessorCalibration::start(const QString &executable,
+                                 const QString &modelDir, int processors)
+{
+    cancel();
+    this->executable = executable;
+    this->modelDir = modelDir;
+    results_.clear();
+    scratch = new QTemporaryDir;
+    if (!scratch->isValid() || !writeTile()) {
+        cancel();
+        emit finished(false);
+        return;
+    }
+
+    // The same models the cropper offers: plain scaling and each noise level.
+    QList<QPair<QString, int> > models = {
+        { "scale", 0 }, { "noise1", 1 }, { "noise2", 2 }
+    };
+    if (QFileInfo(modelDir + "/noise3_model.json").exists())
+        models << qMakePair(QString("noise3"), 3);
+    for (int p = 0; p < processors; p++)
+        for (const auto &model : models)
+            runs << Run{ p, model.first, model.second };
+    total = runs.count();
+    QTimer::singleShot(0, this, SLOT(runNext()));
+}
+
+void ProcessorCalibration::cancel()
+{
+    // Whatever was measured so far is dropped along with the rest.
+    runs.clear();
+    results_.clear();
+    if (process) {
+        process->disconnect(this);
+        process->kill();
+        process->waitForFinished();
+        delete process;
+        process = 0;
+    }
+    delete scratch;
+    scratch = 0;
+}
+
+bool ProcessorCalibration::isRunning() const
+{
+    return scratch != 0;
+}
+
+ProcessorCalibration::Results ProcessorCalibration::results() const
+{
+    return results_;
+}
+
+void ProcessorCalibration::decline(const QString &executable,
+                                   const QString &modelDir)
+{
+    QSettings s;
+    s.setValue("calibrationDeclined/" + cacheKey(executable, modelDir), true);
+}
+
+bool ProcessorCalibration::isDeclined(const QString &executable,
+                                      const QString &modelDir)
+{
+    QSettings s;
+    return s.value("calibrationDeclined/" + cacheKey(executable, modelDir)).toBool();
+}
+
+bool ProcessorCalibration::load(const QString &executable,
+                                const QString &modelDir, Results *results)
+{
+    QSettings s;
+    QByteArray stored = s.value("calibration/" + cacheKey(executable, modelDir))
+            .toByteArray();
+    QJsonObject json = QJsonDocument::fromJson(stored).object();
+    if (json.isEmpty())
+        return false;
+    results->clear();
+    for (auto p = json.constBegin(); p != json.constEnd(); ++p) {
+        QJsonObject models = p.value().toObject();
+        for (auto m = models.constBegin(); m != models.constEnd(); ++m)
+            (*results)[p.key().toInt()][m.key()] = m.value().toDouble();
+    }
+    return true;
+}
+
+int ProcessorCalibration::fastest(const Results &results)
+{
+    // Least total time over all models; a processor that failed any of them
+    // is not trusted with the rest.
+    int best = -1;
+    double bestTime = 0;
+    for (auto p = results.constBegin(); p != results.constEnd(); ++p) {
+        double time = 0;
+        for (double mps : p.value()) {
+            if (mps <= 0) {
+                time = -1;
+                break;
+            }
+            time += 1 / mps;
+        }
+        if (time > 0 && (best < 0 || time < bestTime)) {
+            best = p.key();
+            bestTime = time;
+        }
+    }
+    return best;
+}
+
+void ProcessorCalibration::runNext()
+{
+    // Cancelled after the last run was queued, or already running one.
+    if (!scratch || process)
+        return;
+    if (runs.isEmpty()) {
+        save();
+        delete scratch;
+        scratch = 0;
+        emit finished(true);
+        return;
+    }
+    emit progress(total - runs.count(), total);
+    if (ProcessGovernor::instance()->isInteracting())
+        return;
+    const Run &run = runs.first();
+    QStringList args = {
+        "--scale-ratio", "2.000",
+        "-m", run.noise ? "noise-scale" : "scale",
+        "--model-dir", modelDir,
+        "-i", scratch->filePath("tile.png"),
+        "-o", scratch->filePath("out.png"),
+        "--processor", QString::number(run.processor)
+    };
+    if (run.noise)
+        args << "--noise-level" << QString::number(run.noise);
+    QFile::remove(scratch->filePath("out.png"));
+
+    process = ProcessGovernor::instance()->create(this);
+    process->setProgram(executable);
+    process->setArguments(args);
+    connect(process, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, [this](int exitCode, QProcess::ExitStatus status) {
+        run_finished(status == QProcess::CrashExit ? -1 : exitCode);
+    });
+    connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError e) {
+        if (e == QProcess::FailedToStart)
+            run_finished(-1);
+    });
+    disturbed = false;
+    timer.start();
+    process->start();
+}
+
+void ProcessorCalibration::run_finished(int exitCode)
+{
+    qint64 msecs = timer.elapsed();
+    process->deleteLater();
+    process = 0;
+    if (disturbed) {
+        QTimer::singleShot(0, this, SLOT(runNext()));
+        return;
+    }
+    Run run = runs.takeFirst();
+    bool ok = exitCode == 0 && QFileInfo(scratch->filePath("out.png")).size() > 0;
+    double megapixels = tileSize * tileSize / 1e6;
+    results_[run.processor][run.model] = ok ? megapixels * 1000 / qMax<qint64>(1, msecs)
+                                            : 0.0;
+    QTimer::singleShot(0, this, SLOT(runNext()));
+}
+
+QString ProcessorCalibration::cacheKey(const QString &executable,
+                                       const QString &modelDir)
+{
+    // A rebuilt or upgraded waifu2x, another host sharing the home folder or
+    // another set of models all call for fresh numbers.
+    QFileInfo exe(executable);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(exe.absoluteFilePath().toUtf8());
+    hash.addData(QByteArray::number(exe.size()));
+    hash.addData(QByteArray::number(exe.lastModified().toMSecsSinceEpoch()));
+    hash.addData(QSysInfo::machineHostName().toUtf8());
+    hash.addData(QFileInfo(modelDir).absoluteFilePath().toUtf8());
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+bool ProcessorCalibration::writeTile()
+{
+    // Smooth gradients with fine detail and noise on top, from a fixed seed
+    // so that every machine times the same picture.
+    QImage tile(tileSize, tileSize, QImage::Format_RGB32);
+    quint32 seed = 12345;
+    for (int y = 0; y < tileSize; y++) {
+        QRgb *line = reinterpret_cast<QRgb*>(tile.scanLine(y));
+        for (int x = 0; x < tileSize; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            int n = (seed >> 24) % 24;
+            int r = (x * 255 / tileSize + n) & 255;
+            int g = (y * 255 / tileSize + n) & 255;
+            int b = (((x / 8) ^ (y / 8)) & 1 ? 200 : 60) + n;
+            line[x] = qRgb(r, g, qMin(255, b));
+        }
+    }
+    return tile.save(scratch->filePath("tile.png"));
+}
+
+void ProcessorCalibration::save()
+{
+    QJsonObject json;
+    for (auto p = results_.constBegin(); p != results_.constEnd(); ++p) {
+        QJsonObject models;
+        for (auto m = p.value().constBegin(); m != p.value().constEnd(); ++m)
+            models[m.key()] = m.value();
+        json[QString::number(p.key())] = models;
+    }
+    QSettings s;
+    s.setValue("calibration/" + cacheKey(executable, modelDir),
+               QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
@@ -0,0 +1,72 @@
+#ifndef PROCESSORCALIBRATION_H
+#define PROCESSORCALIBRATION_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+#include <QTemporaryDir>
+
+class QProcess;
+
+// Times waifu2x on a standard tile with every processor it lists and every
+// noise model, one run at a time, and remembers the throughput per
+// executable, host and model folder so that the fastest processor can be
+// chosen without guesswork.  The runs are governed like any other child, and
+// only complete sets of numbers are kept.
+class ProcessorCalibration : public QObject {
+    Q_OBJECT
+public:
+    // Megapixels of input per second, by processor and then by model; 0 where
+    // the run failed.
+    typedef QMap<int, QMap<QString, double> > Results;
+
+    ProcessorCalibration(QObject *parent = 0);
+    ~ProcessorCalibration();
+
+    void start(const QString &executable, const QString &modelDir,
+               int processors);
+    void cancel();
+    bool isRunning() const;
+    Results results() const;
+
+    // Remembers that the operator stopped a calibration of this waifu2x, so
+    // that it is not started again unasked.
+    static void decline(const QString &executable, const QString &modelDir);
+    static bool isDeclined(const QString &executable, const QString &modelDir);
+    static bool load(const QString &executable, const QString &modelDir,
+                     Results *results);
+    static int fastest(const Results &results);
+
+signals:
+    void progress(int done, int total);
+    void finished(bool ok);
+
+private slots:
+    void runNext();
+    void run_finished(int exitCode);
+
+private:
+    struct Run {
+        int processor;
+        QString model;
+        int noise;
+    };
+
+    static QString cacheKey(const QString &executable, const QString &modelDir);
+    bool writeTile();
+    void save();
+
+    QString executable;
+    QString modelDir;
+    QList<Run> runs;
+    int total;
+    Results results_;
+    QTemporaryDir *scratch;
+    QProcess *process;
+    bool disturbed;
+    QElapsedTimer timer;
+};
+
+#endif // PROCESSORCALIBRATION_H
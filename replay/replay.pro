@@ -0,0 +1,15 @@
+# Replays recorded operator sessions offscreen and reports frame timings.
+#   QT_QPA_PLATFORM=offscreen ./darkcropper-replay session.trace
+
+TARGET = darkcropper-replay
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../darkcropper.pri)
+
+SOURCES += sessionreplay.cpp \
+    replaystub.cpp
+
+HEADERS += sessionreplay.h \
+    replaystub.h
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include "replaystub.h"
+
+static QString argumentAfter(const QStringList &args, const QString &flag)
+{
+    int index = args.indexOf(flag);
+    if (index < 0 || index + 1 >= args.count())
+        return QString();
+    return args.at(index + 1);
+}
+
+static int waifu2x(const QStringList &args)
+{
+    if (args.contains("--list-processor")) {
+        std::printf("   0: Replay stub processor\n");
+        return 0;
+    }
+    QImage in(argumentAfter(args, "-i"));
+    if (in.isNull())
+        return 1;
+    QImage out = in.scaled(in.size() * 2, Qt::IgnoreAspectRatio,
+                           Qt::SmoothTransformation);
+    return out.save(argumentAfter(args, "-o")) ? 0 : 1;
+}
+
+static int convert(const QStringList &args)
+{
+    // Resource limits come first, as "-limit <resource> <value>".
+    int first = 0;
+    while (first + 2 < args.count() && args.at(first) == "-limit")
+        first += 3;
+    if (args.count() - first < 2)
+        return 1;
+    // The export may read only a region, as "<file>[<geometry>]".
+    QString input = args.at(first);
+    if (input.endsWith(']') && input.contains('['))
+        input.truncate(input.lastIndexOf('['));
+    QImage in(input);
+    QStringList size = argumentAfter(args, "-size").split('x');
+    if (in.isNull() || size.count() != 2)
+        return 1;
+    QImage out(size.at(0).toInt(), size.at(1).toInt(), QImage::Format_RGB32);
+    out.fill(QColor(0x30, 0x30, 0x30));
+    QPainter p(&out);
+    p.setRenderHint(QPainter::SmoothPixmapTransform);
+    QSize fitted = in.size().scaled(out.size(), Qt::KeepAspectRatio);
+    p.drawImage(QRect(QPoint((out.width() - fitted.width()) / 2,
+                             (out.height() - fitted.height()) / 2), fitted), in);
+    p.end();
+    return out.save(args.last()) ? 0 : 1;
+}
+
+bool ReplayStub::install(const QString &folder, const QString &replayBinary)
+{
+    for (const QString &tool : { "waifu2x-converter-cpp", "convert" }) {
+        QFile f(folder + "/" + tool);
+        if (!f.open(QFile::WriteOnly | QFile::Truncate))
+            return false;
+        f.write(QString("#!/bin/sh\nexec '%1' --stub %2 \"$@\"\n")
+                .arg(replayBinary, tool).toLocal8Bit());
+        f.close();
+        f.setPermissions(f.permissions() | QFile::ExeOwner | QFile::ExeUser);
+    }
+    return true;
+}
+
+int ReplayStub::run(const QString &tool, const QStringList &args)
+{
+    if (tool == "waifu2x-converter-cpp")
+        return waifu2x(args);
+    if (tool == "convert")
+        return convert(args);
+    return 127;
+}
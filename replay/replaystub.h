@@ -0,0 +1,14 @@
+#ifndef REPLAYSTUB_H
+#define REPLAYSTUB_H
+
+#include <QStringList>
+
+// Stand-ins for waifu2x-converter-cpp and convert, so that sessions can be
+// replayed on machines without the real tools.  They do comparable I/O and
+// resampling work, but make no attempt to match the real output.
+namespace ReplayStub {
+    bool install(const QString &folder, const QString &replayBinary);
+    int run(const QString &tool, const QStringList &args);
+}
+
+#endif // REPLAYSTUB_H
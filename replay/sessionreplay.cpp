@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <QAction>
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QListWidget>
+#include <QMouseEvent>
+#include <QPushButton>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+#include "sessionreplay.h"
+#include "replaystub.h"
+#include "mainwindow.h"
+#include "imagewindow.h"
+
+static QJsonObject distribution(QVector<double> samples)
+{
+    QJsonObject d;
+    d["count"] = samples.count();
+    if (samples.isEmpty())
+        return d;
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+    auto percentile = [&samples](double p) {
+        return samples.at(std::min<int>(samples.count() - 1, p * samples.count()));
+    };
+    d["mean_ms"] = sum / samples.count();
+    d["p50_ms"] = percentile(0.50);
+    d["p90_ms"] = percentile(0.90);
+    d["p99_ms"] = percentile(0.99);
+    d["max_ms"] = samples.last();
+    return d;
+}
+
+
+
+SessionReplay::SessionReplay(QObject *parent)
+    : QObject(parent), position(0), speed(1.0), drainTime(2000),
+      mainWindow(NULL), imageWindow(NULL), wallTime(0)
+{
+}
+
+bool SessionReplay::load(const QString &filename)
+{
+    QFile f(filename);
+    if (!f.open(QFile::ReadOnly | QFile::Text))
+        return false;
+    traceFilename = filename;
+    events.clear();
+    while (!f.atEnd()) {
+        QJsonDocument doc = QJsonDocument::fromJson(f.readLine());
+        if (doc.isObject())
+            events << doc.object();
+    }
+    return !events.isEmpty();
+}
+
+void SessionReplay::setSpeed(qreal speed)
+{
+    this->speed = speed;
+}
+
+void SessionReplay::setDrainTime(int msec)
+{
+    drainTime = msec;
+}
+
+void SessionReplay::setImageFolder(const QString &folder)
+{
+    imageFolder = folder;
+}
+
+void SessionReplay::start(MainWindow *mainWindow, ImageWindow *imageWindow)
+{
+    this->mainWindow = mainWindow;
+    this->imageWindow = imageWindow;
+    connect(imageWindow, &ImageWindow::framePainted,
+            this, [this](qint64 nsecs) {
+        frameTimes << nsecs / 1e6;
+    });
+    connect(imageWindow, &ImageWindow::firstFramePainted,
+            this, [this](QString filename, qint64 nsecs) {
+        QJsonObject entry;
+        entry["file"] = filename;
+        entry["first_frame_ms"] = nsecs / 1e6;
+        firstFrames.append(entry);
+    });
+    position = 0;
+    clock.start();
+    nextEvent();
+}
+
+QJsonObject SessionReplay::report()
+{
+    QVector<double> firstFrameTimes;
+    for (const QJsonValue &v : firstFrames)
+        firstFrameTimes << v.toObject()["first_frame_ms"].toDouble();
+
+    QJsonObject r;
+    r["trace"] = traceFilename;
+    r["events"] = events.count();
+    r["speed"] = speed;
+    r["wall_time_ms"] = (double)wallTime;
+    r["frames"] = distribution(frameTimes);
+    r["first_frame"] = distribution(firstFrameTimes);
+    r["first_frame_per_image"] = firstFrames;
+    return r;
+}
+
+void SessionReplay::nextEvent()
+{
+    while (position < events.count()) {
+        const QJsonObject &event = events.at(position);
+        qint64 due = speed > 0 ? event["t"].toDouble() / speed : 0;
+        qint64 wait = due - clock.elapsed();
+        if (wait > 0) {
+            QTimer::singleShot(wait, this, SLOT(nextEvent()));
+            return;
+        }
+        position++;
+        dispatch(event);
+        if (speed <= 0) {
+            // Let the paint caused by this event happen before the next one.
+            QTimer::singleShot(0, this, SLOT(nextEvent()));
+            return;
+        }
+    }
+    QTimer::singleShot(drainTime, this, SLOT(finish()));
+}
+
+void SessionReplay::finish()
+{
+    wallTime = clock.elapsed();
+    emit finished();
+}
+
+void SessionReplay::dispatch(const QJsonObject &event)
+{
+    QString type = event["type"].toString();
+    if (type == "start") {
+        QListWidget *fileList = mainWindow->findChild<QListWidget*>("fileList");
+        fileList->clear();
+        for (const QJsonValue &v : event["files"].toArray())
+            fileList->addItem(mapFile(v.toString()));
+        mainWindow->findChild<QPushButton*>("start")->click();
+    } else if (type == "resize") {
+        imageWindow->window()->resize(event["width"].toInt(),
+                                      event["height"].toInt());
+    } else if (type == "press" || type == "move" || type == "release") {
+        QEvent::Type t = type == "press" ? QEvent::MouseButtonPress
+                       : type == "move" ? QEvent::MouseMove
+                                        : QEvent::MouseButtonRelease;
+        QMouseEvent me(t, QPointF(event["x"].toDouble(), event["y"].toDouble()),
+                       Qt::MouseButton(event["button"].toInt()),
+                       Qt::MouseButtons(event["buttons"].toInt()),
+                       Qt::KeyboardModifiers(event["modifiers"].toInt()));
+        QApplication::sendEvent(imageWindow, &me);
+    } else if (type == "action") {
+        QString name = event["name"].toString();
+        for (QAction *action : imageWindow->actions()) {
+            if (action->text() == name) {
+                action->trigger();
+                break;
+            }
+        }
+    }
+}
+
+QString SessionReplay::mapFile(const QString &filename)
+{
+    if (imageFolder.isEmpty())
+        return filename;
+    return imageFolder + "/" + QFileInfo(filename).fileName();
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && QByteArray(argv[1]) == "--stub") {
+        QStringList args;
+        for (int i = 3; i < argc; i++)
+            args << QString::fromLocal8Bit(argv[i]);
+        return ReplayStub::run(argv[2], args);
+    }
+
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+    QCoreApplication::setApplicationName("Dark Cropper Replay");
+    QCoreApplication::setOrganizationName("cmdrkotori");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a session recorded with darkcropper --record.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Trace file to replay.");
+    QCommandLineOption outputOption({"o", "output"},
+            "Write the JSON report to <file> (- for stdout).", "file", "-");
+    QCommandLineOption speedOption("speed",
+            "Playback speed; 0 replays as fast as possible.", "factor", "1");
+    QCommandLineOption drainOption("drain",
+            "Wait <msec> after the last event for jobs to finish.", "msec", "2000");
+    QCommandLineOption imagesOption("images",
+            "Load the traced images from <folder> instead.", "folder");
+    QCommandLineOption exportOption("export-folder",
+            "Write exports to <folder> instead of a temporary one.", "folder");
+    QCommandLineOption realToolsOption("real-tools",
+            "Use the installed waifu2x-converter-cpp and convert.");
+    parser.addOptions({ outputOption, speedOption, drainOption, imagesOption,
+                        exportOption, realToolsOption });
+    parser.process(a);
+    if (parser.positionalArguments().count() != 1)
+        parser.showHelp(1);
+
+    QTextStream err(stderr);
+    SessionReplay replay;
+    if (!replay.load(parser.positionalArguments().first())) {
+        err << "could not read trace " << parser.positionalArguments().first() << endl;
+        return 1;
+    }
+    replay.setSpeed(parser.value(speedOption).toDouble());
+    replay.setDrainTime(parser.value(drainOption).toInt());
+    replay.setImageFolder(parser.value(imagesOption));
+
+    QTemporaryDir scratch;
+    QString exportFolder = parser.isSet(exportOption) ? parser.value(exportOption)
+                                                      : scratch.path();
+    QSettings s;
+    s.clear();
+    s.setValue("fullscreen", false);
+    s.setValue("windowed", true);
+    s.setValue("sameFolder", false);
+    s.setValue("otherFolder", true);
+    s.setValue("otherFolderText", exportFolder);
+    if (!parser.isSet(realToolsOption)) {
+        if (!ReplayStub::install(scratch.path(), QCoreApplication::applicationFilePath())) {
+            err << "could not install tool stubs" << endl;
+            return 1;
+        }
+        qputenv("PATH", scratch.path().toLocal8Bit() + ":" + qgetenv("PATH"));
+        qputenv("DARKCROPPER_MAGICK", "");
+        s.setValue("waifu2xExecutable", scratch.path());
+        s.setValue("waifu2xModelDir", scratch.path());
+    }
+    s.sync();
+
+    MainWindow w;
+    ImageWindow *cropper = NULL;
+    for (QWidget *widget : QApplication::topLevelWidgets())
+        if (!cropper)
+            cropper = qobject_cast<ImageWindow*>(widget);
+    if (!cropper) {
+        err << "no image window" << endl;
+        return 1;
+    }
+
+    QObject::connect(&replay, &SessionReplay::finished, &a, &QApplication::quit);
+    replay.start(&w, cropper);
+    a.exec();
+
+    QJsonObject report = replay.report();
+    QJsonObject frames = report["frames"].toObject();
+    err << "frames: " << frames["count"].toInt()
+        << ", p50 " << frames["p50_ms"].toDouble() << " ms"
+        << ", p99 " << frames["p99_ms"].toDouble() << " ms"
+        << "; wall time " << report["wall_time_ms"].toDouble() << " ms" << endl;
+
+    QString output = parser.value(outputOption);
+    QFile f(output);
+    bool opened = output == "-" ? f.open(stdout, QFile::WriteOnly)
+                                : f.open(QFile::WriteOnly | QFile::Truncate);
+    if (!opened) {
+        err << "could not write " << output << endl;
+        return 1;
+    }
+    f.write(QJsonDocument(report).toJson());
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef SESSIONREPLAY_H
+#define SESSIONREPLAY_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QVector>
+
+class MainWindow;
+class ImageWindow;
+
+// Feeds a trace written by SessionRecorder back into a live MainWindow and
+// collects frame times, time-to-first-frame and the session wall time.
+class SessionReplay : public QObject {
+    Q_OBJECT
+public:
+    SessionReplay(QObject *parent = 0);
+    bool load(const QString &filename);
+    void setSpeed(qreal speed);
+    void setDrainTime(int msec);
+    void setImageFolder(const QString &folder);
+    void start(MainWindow *mainWindow, ImageWindow *imageWindow);
+    QJsonObject report();
+
+signals:
+    void finished();
+
+private slots:
+    void nextEvent();
+    void finish();
+
+private:
+    void dispatch(const QJsonObject &event);
+    QString mapFile(const QString &filename);
+
+    QString traceFilename;
+    QList<QJsonObject> events;
+    int position;
+    qreal speed;
+    int drainTime;
+    QString imageFolder;
+
+    MainWindow *mainWindow;
+    ImageWindow *imageWindow;
+    QElapsedTimer clock;
+    qint64 wallTime;
+    QVector<double> frameTimes;
+    QJsonArray firstFrames;
+};
+
+#endif // SESSIONREPLAY_H
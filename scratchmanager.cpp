@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <signal.h>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QUuid>
+#include "scratchmanager.h"
+
+ScratchManager *ScratchManager::instance()
+{
+    static ScratchManager manager;
+    return &manager;
+}
+
+ScratchManager::ScratchManager()
+    : folder_("/dev/shm"), quota_(qint64(2048) << 20), usage_(0)
+{
+    spillFolder_ = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + "/scratch";
+}
+
+ScratchManager::~ScratchManager()
+{
+    for (const QString &filename : files.keys())
+        QFile::remove(filename);
+}
+
+void ScratchManager::setFolder(const QString &folder)
+{
+    folder_ = folder;
+    emit changed();
+}
+
+QString ScratchManager::folder() const
+{
+    return folder_;
+}
+
+QString ScratchManager::spillFolder() const
+{
+    return spillFolder_;
+}
+
+void ScratchManager::setQuota(qint64 bytes)
+{
+    quota_ = bytes;
+    emit changed();
+}
+
+qint64 ScratchManager::quota() const
+{
+    return quota_;
+}
+
+qint64 ScratchManager::usage() const
+{
+    return usage_;
+}
+
+QString ScratchManager::allocate(const QString &suffix, qint64 expectedBytes)
+{
+    // Only what lands in the scratch folder counts towards the quota; the
+    // spill folder is plain disk.
+    QString target = folder_;
+    if (usage_ + expectedBytes > quota_ || !QDir().mkpath(target)) {
+        target = spillFolder_;
+        QDir().mkpath(target);
+    }
+    QString filename = uniqueName(target, suffix);
+    files.insert(filename, 0);
+    return filename;
+}
+
+void ScratchManager::update(const QString &filename)
+{
+    auto it = files.find(filename);
+    if (it == files.end())
+        return;
+    qint64 bytes = filename.startsWith(folder_ + "/") ? QFileInfo(filename).size()
+                                                      : 0;
+    usage_ += bytes - *it;
+    *it = bytes;
+    emit changed();
+}
+
+void ScratchManager::release(const QString &filename)
+{
+    QFile::remove(filename);
+    auto it = files.find(filename);
+    if (it == files.end())
+        return;
+    usage_ -= *it;
+    files.erase(it);
+    emit changed();
+}
+
+bool ScratchManager::isInMemory(const QString &filename) const
+{
+    QStorageInfo storage(QFileInfo(filename).absolutePath());
+    return storage.fileSystemType() == "tmpfs"
+            || storage.fileSystemType() == "ramfs";
+}
+
+QString ScratchManager::uniqueName(const QString &folder, const QString &suffix)
+{
+    QString uuid = QUuid::createUuid().toString();
+    uuid = uuid.mid(1, uuid.length() - 2);
+    return QString("%1/darkcropper-%2-%3.%4").arg(folder)
+            .arg(QCoreApplication::applicationPid()).arg(uuid).arg(suffix);
+}
+
+int ScratchManager::removeOrphans(const QString &folder)
+{
+    static const QRegularExpression owned("^darkcropper-(\\d+)-");
+    QDateTime dayAgo = QDateTime::currentDateTime().addDays(-1);
+    int removed = 0;
+    QDir d(folder);
+    for (const QFileInfo &info : d.entryInfoList({"darkcropper-*"}, QDir::Files)) {
+        QRegularExpressionMatch m = owned.match(info.fileName());
+        bool orphan;
+        if (m.hasMatch()) {
+            pid_t pid = m.captured(1).toInt();
+            orphan = pid != QCoreApplication::applicationPid()
+                    && kill(pid, 0) != 0 && errno == ESRCH;
+        } else {
+            // Names from before the pid was recorded; nobody can claim them.
+            orphan = info.lastModified() < dayAgo;
+        }
+        if (orphan && QFile::remove(info.absoluteFilePath()))
+            removed++;
+    }
+    return removed;
+}
+
+int ScratchManager::removeOrphans()
+{
+    return removeOrphans(folder_) + removeOrphans(spillFolder_);
+}
@@ -0,0 +1,47 @@
+#ifndef SCRATCHMANAGER_H
+#define SCRATCHMANAGER_H
+
+#include <QHash>
+#include <QObject>
+
+// Hands out names for working copies (doubled images and the like) and keeps
+// track of how much they take up.  New files go to the scratch folder while it
+// is under quota and spill to the disk cache otherwise.  Every name carries the
+// pid of the process that made it, so leftovers of a crashed run can be told
+// apart from files another running instance is still using.
+class ScratchManager : public QObject {
+    Q_OBJECT
+public:
+    static ScratchManager *instance();
+
+    void setFolder(const QString &folder);
+    QString folder() const;
+    QString spillFolder() const;
+    void setQuota(qint64 bytes);
+    qint64 quota() const;
+    qint64 usage() const;
+
+    QString allocate(const QString &suffix, qint64 expectedBytes);
+    void update(const QString &filename);
+    void release(const QString &filename);
+    bool isInMemory(const QString &filename) const;
+
+    static QString uniqueName(const QString &folder, const QString &suffix);
+    static int removeOrphans(const QString &folder);
+    int removeOrphans();
+
+signals:
+    void changed();
+
+private:
+    ScratchManager();
+    ~ScratchManager();
+
+    QString folder_;
+    QString spillFolder_;
+    qint64 quota_;
+    qint64 usage_;
+    QHash<QString, qint64> files;
+};
+
+#endif // SCRATCHMANAGER_H
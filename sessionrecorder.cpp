@@ -0,0 +1,87 @@
+#include <QAction>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QListWidget>
+#include <QMainWindow>
+#include <QMouseEvent>
+#include <QPushButton>
+#include <QResizeEvent>
+#include "sessionrecorder.h"
+#include "imagewindow.h"
+
+SessionRecorder::SessionRecorder(const QString &filename, QObject *parent)
+    : QObject(parent), trace(filename)
+{
+    trace.open(QFile::WriteOnly | QFile::Truncate | QFile::Text);
+    clock.start();
+}
+
+bool SessionRecorder::isOpen()
+{
+    return trace.isOpen();
+}
+
+void SessionRecorder::attach(QMainWindow *mainWindow, ImageWindow *imageWindow)
+{
+    QListWidget *fileList = mainWindow->findChild<QListWidget*>("fileList");
+    QPushButton *start = mainWindow->findChild<QPushButton*>("start");
+    if (fileList && start) {
+        connect(start, &QPushButton::clicked, this, [this, fileList]() {
+            QJsonArray files;
+            for (int i = 0; i < fileList->count(); i++)
+                files.append(fileList->item(i)->text());
+            record("start", {{"files", files}});
+        });
+    }
+
+    for (QAction *action : imageWindow->actions()) {
+        connect(action, &QAction::triggered, this, [this, action]() {
+            record("action", {{"name", action->text()}});
+        });
+    }
+    connect(imageWindow, &ImageWindow::firstFramePainted,
+            this, [this](QString filename, qint64 nsecs) {
+        record("source", {{"file", filename}, {"first_frame_ms", nsecs / 1e6}});
+    });
+    imageWindow->installEventFilter(this);
+}
+
+bool SessionRecorder::eventFilter(QObject *watched, QEvent *event)
+{
+    switch (event->type()) {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::MouseButtonRelease: {
+        QMouseEvent *me = static_cast<QMouseEvent*>(event);
+        QString type = event->type() == QEvent::MouseButtonPress ? "press"
+                     : event->type() == QEvent::MouseMove ? "move"
+                                                          : "release";
+        record(type, {{"x", me->localPos().x()},
+                      {"y", me->localPos().y()},
+                      {"button", (int)me->button()},
+                      {"buttons", (int)me->buttons()},
+                      {"modifiers", (int)me->modifiers()}});
+        break;
+    }
+    case QEvent::Resize: {
+        QResizeEvent *re = static_cast<QResizeEvent*>(event);
+        record("resize", {{"width", re->size().width()},
+                          {"height", re->size().height()}});
+        break;
+    }
+    default:
+        break;
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void SessionRecorder::record(const QString &type, QJsonObject event)
+{
+    if (!trace.isOpen())
+        return;
+    event["t"] = clock.nsecsElapsed() / 1e6;
+    event["type"] = type;
+    trace.write(QJsonDocument(event).toJson(QJsonDocument::Compact));
+    trace.write("\n");
+    trace.flush();
+}
@@ -0,0 +1,31 @@
+#ifndef SESSIONRECORDER_H
+#define SESSIONRECORDER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+
+class QMainWindow;
+class ImageWindow;
+
+// Writes an operator session as a trace of JSON lines, one event per line,
+// which darkcropper-replay can feed back through the same widgets.
+class SessionRecorder : public QObject {
+    Q_OBJECT
+public:
+    SessionRecorder(const QString &filename, QObject *parent = 0);
+    bool isOpen();
+    void attach(QMainWindow *mainWindow, ImageWindow *imageWindow);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event);
+
+private:
+    void record(const QString &type, QJsonObject event = QJsonObject());
+
+    QFile trace;
+    QElapsedTimer clock;
+};
+
+#endif // SESSIONRECORDER_H
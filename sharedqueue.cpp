@@ -0,0 +1,217 @@
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+#include "sharedqueue.h"
+#include "jsonfile.h"
+
+static QString leaseOwner(const QString &lease)
+{
+    return JsonFile::read(lease + "/owner.json").value("owner").toString();
+}
+
+
+
+SharedQueue::SharedQueue(const QString &folder)
+    : folder_(folder)
+{
+}
+
+void SharedQueue::setFolder(const QString &folder)
+{
+    folder_ = folder;
+}
+
+QString SharedQueue::folder() const
+{
+    return folder_;
+}
+
+bool SharedQueue::create()
+{
+    if (folder_.isEmpty())
+        return false;
+    for (const char *sub : { "tmp", "claims", "done", "operators" })
+        if (!QDir().mkpath(path(sub)))
+            return false;
+    return true;
+}
+
+bool SharedQueue::claim(const QString &filename, const QString &owner)
+{
+    if (isDone(filename))
+        return false;
+    QString lease = claimPath(filename);
+    // Whoever makes the directory first holds the file.
+    if (!QDir().mkdir(lease))
+        return leaseOwner(lease) == owner;
+    QJsonObject json;
+    json["file"] = QFileInfo(filename).absoluteFilePath();
+    json["owner"] = owner;
+    json["claimed"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    if (!JsonFile::write(path("tmp"), lease + "/owner.json", json)) {
+        QDir(lease).removeRecursively();
+        return false;
+    }
+    // Finished by its last holder between the check above and the mkdir.
+    if (isDone(filename)) {
+        QDir(lease).removeRecursively();
+        return false;
+    }
+    return true;
+}
+
+void SharedQueue::release(const QString &filename, const QString &owner)
+{
+    QString lease = claimPath(filename);
+    if (leaseOwner(lease) != owner)
+        return;
+    QString aside = setAside(lease);
+    if (!aside.isEmpty())
+        QDir(aside).removeRecursively();
+}
+
+void SharedQueue::finish(const QString &filename, const QString &owner)
+{
+    // The marker goes down before the lease comes up, so that nobody can
+    // claim the file in between.
+    QJsonObject json;
+    json["file"] = QFileInfo(filename).absoluteFilePath();
+    json["owner"] = owner;
+    json["finished"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    JsonFile::write(path("tmp"), donePath(filename), json);
+    release(filename, owner);
+}
+
+bool SharedQueue::isDone(const QString &filename) const
+{
+    return QFileInfo::exists(donePath(filename));
+}
+
+int SharedQueue::expireStale(int maxAgeSecs)
+{
+    QDir claims(path("claims"));
+    int expired = 0;
+    for (const QString &name : claims.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QString lease = claims.filePath(name);
+        QString owner = leaseOwner(lease);
+        if (owner.isEmpty()) {
+            // Still being written, or its writer died before it could be.
+            if (heartbeats.isChanging(lease, QByteArray(), maxAgeSecs))
+                continue;
+        } else {
+            heartbeats.forget(lease);
+            if (heartbeats.isAlive(path("operators") + "/" + owner + ".json", maxAgeSecs))
+                continue;
+        }
+        // Moved aside first, so that only one instance expires it; should it
+        // have changed hands since it was read, it goes back.
+        QString aside = setAside(lease);
+        if (aside.isEmpty())
+            continue;
+        heartbeats.forget(lease);
+        if (leaseOwner(aside) != owner) {
+            if (QDir().rename(aside, lease))
+                continue;
+            // Claimed afresh in the meantime; the one set aside is lost to
+            // its owner either way.
+            qWarning("could not restore lease %s from %s", qPrintable(lease),
+                     qPrintable(aside));
+        }
+        if (!QDir(aside).removeRecursively())
+            qWarning("could not remove expired lease %s", qPrintable(aside));
+        expired++;
+    }
+    sweep(maxAgeSecs);
+    return expired;
+}
+
+void SharedQueue::heartbeat(const QString &owner, const QJsonObject &state)
+{
+    QJsonObject beat = state;
+    beat["operator"] = owner;
+    // This host's clock, only ever compared with its own previous beat.
+    beat["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    JsonFile::write(path("tmp"), path("operators") + "/" + owner + ".json", beat);
+}
+
+void SharedQueue::retire(const QString &owner)
+{
+    QDir claims(path("claims"));
+    for (const QString &name : claims.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QString lease = claims.filePath(name);
+        if (leaseOwner(lease) != owner)
+            continue;
+        QString aside = setAside(lease);
+        if (!aside.isEmpty())
+            QDir(aside).removeRecursively();
+    }
+    QFile::remove(path("operators") + "/" + owner + ".json");
+}
+
+QList<QJsonObject> SharedQueue::operators(int maxAgeSecs) const
+{
+    QList<QJsonObject> alive;
+    QDir d(path("operators"));
+    for (const QFileInfo &info : d.entryInfoList({"*.json"}, QDir::Files))
+        if (heartbeats.isAlive(info.absoluteFilePath(), maxAgeSecs))
+            alive << JsonFile::read(info.absoluteFilePath());
+    return alive;
+}
+
+int SharedQueue::claimed() const
+{
+    return QDir(path("claims")).entryList(QDir::Dirs | QDir::NoDotAndDotDot).count();
+}
+
+int SharedQueue::done() const
+{
+    return QDir(path("done")).entryList({"*.json"}, QDir::Files).count();
+}
+
+QString SharedQueue::setAside(const QString &lease)
+{
+    // Set-aside leases are named apart from the JSON written through tmp/,
+    // so that sweep() can tell them from files still being written.
+    QString aside = path("tmp") + "/lease-" + QUuid::createUuid().toString().mid(1, 36);
+    return QDir().rename(lease, aside) ? aside : QString();
+}
+
+void SharedQueue::sweep(int maxAgeSecs)
+{
+    // Whoever set a lease aside removes it at once; one still here a whole
+    // window later was left by an instance that failed or died doing so.
+    QDir tmp(path("tmp"));
+    for (const QString &name : tmp.entryList({"lease-*"}, QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QString aside = tmp.filePath(name);
+        if (heartbeats.isChanging(aside, QByteArray(), maxAgeSecs))
+            continue;
+        heartbeats.forget(aside);
+        if (!QDir(aside).removeRecursively())
+            qWarning("could not sweep lease %s", qPrintable(aside));
+    }
+}
+
+QString SharedQueue::path(const QString &sub) const
+{
+    return folder_ + "/" + sub;
+}
+
+QString SharedQueue::claimPath(const QString &filename) const
+{
+    return path("claims") + "/" + key(filename);
+}
+
+QString SharedQueue::donePath(const QString &filename) const
+{
+    return path("done") + "/" + key(filename) + ".json";
+}
+
+QString SharedQueue::key(const QString &filename)
+{
+    QByteArray absolute = QFileInfo(filename).absoluteFilePath().toUtf8();
+    return QString::fromLatin1(QCryptographicHash::hash(absolute,
+                                                        QCryptographicHash::Sha1).toHex());
+}
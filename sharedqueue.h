@@ -0,0 +1,52 @@
+#ifndef SHAREDQUEUE_H
+#define SHAREDQUEUE_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include "heartbeatmonitor.h"
+
+// Claims on source files, kept in a directory that several darkcropper
+// instances cropping the same inbox can all see.  An instance only crops what
+// it holds a lease on, and a file once finished is never handed out again.
+// Leases are directories because creating one is atomic and fails if it is
+// already there, even over NFS:
+//   claims/<key>/owner.json    held by an operator
+//   done/<key>.json            exported or skipped
+//   operators/<name>.json      heartbeats; a lease lives as long as its owner's
+//   tmp/lease-<uuid>/          leases on their way out
+// where <key> is a hash of the source's absolute path, so every host has to
+// mount the inbox at the same place.
+class SharedQueue {
+public:
+    SharedQueue(const QString &folder = QString());
+    void setFolder(const QString &folder);
+    QString folder() const;
+    bool create();
+
+    // True if the file is now, or already was, held by owner.
+    bool claim(const QString &filename, const QString &owner);
+    void release(const QString &filename, const QString &owner);
+    void finish(const QString &filename, const QString &owner);
+    bool isDone(const QString &filename) const;
+    int expireStale(int maxAgeSecs);
+
+    void heartbeat(const QString &owner, const QJsonObject &state);
+    void retire(const QString &owner);
+    QList<QJsonObject> operators(int maxAgeSecs) const;
+    int claimed() const;
+    int done() const;
+
+private:
+    QString setAside(const QString &lease);
+    void sweep(int maxAgeSecs);
+    QString path(const QString &sub) const;
+    QString claimPath(const QString &filename) const;
+    QString donePath(const QString &filename) const;
+    static QString key(const QString &filename);
+
+    QString folder_;
+    mutable HeartbeatMonitor heartbeats;
+};
+
+#endif // SHAREDQUEUE_H
@@ -0,0 +1,53 @@
+#include <QRunnable>
+#include "spoolmonitor.h"
+
+// Workers that have not beaten for this long are not counted.
+static const int workerSilenceSecs = 15;
+
+class SpoolPollTask : public QRunnable {
+public:
+    SpoolPollTask(SpoolMonitor *owner, const QString &folder)
+        : owner(owner), folder(folder) {}
+
+    void run()
+    {
+        ExportSpool &spool = owner->spool;
+        spool.setFolder(folder);
+        QMetaObject::invokeMethod(owner, "counted", Qt::QueuedConnection,
+                                  Q_ARG(int, spool.waiting()),
+                                  Q_ARG(int, spool.claimed()),
+                                  Q_ARG(int, spool.workers(workerSilenceSecs).count()),
+                                  Q_ARG(int, spool.failed()));
+    }
+
+private:
+    SpoolMonitor *owner;
+    QString folder;
+};
+
+
+
+SpoolMonitor::SpoolMonitor(QObject *parent)
+    : QObject(parent), polling(false)
+{
+    pool.setMaxThreadCount(1);
+}
+
+SpoolMonitor::~SpoolMonitor()
+{
+    pool.waitForDone();
+}
+
+void SpoolMonitor::poll(const QString &folder)
+{
+    if (polling || folder.isEmpty())
+        return;
+    polling = true;
+    pool.start(new SpoolPollTask(this, folder));
+}
+
+void SpoolMonitor::counted(int waiting, int claimed, int workers, int failed)
+{
+    polling = false;
+    emit polled(waiting, claimed, workers, failed);
+}
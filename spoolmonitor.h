@@ -0,0 +1,35 @@
+#ifndef SPOOLMONITOR_H
+#define SPOOLMONITOR_H
+
+#include <QObject>
+#include <QThreadPool>
+#include "exportspool.h"
+
+// Counts what is in the export spool for the status line.  The spool usually
+// sits on a network share, so the directories are listed on a thread of its
+// own, one poll at a time; a poll asked for while one is still out is dropped.
+class SpoolMonitor : public QObject {
+    Q_OBJECT
+public:
+    SpoolMonitor(QObject *parent = 0);
+    ~SpoolMonitor();
+
+    void poll(const QString &folder);
+
+signals:
+    void polled(int waiting, int claimed, int workers, int failed);
+
+private slots:
+    void counted(int waiting, int claimed, int workers, int failed);
+
+private:
+    friend class SpoolPollTask;
+
+    QThreadPool pool;
+    // Only touched by the poll under way, which keeps its heartbeat history
+    // from one poll to the next.
+    ExportSpool spool;
+    bool polling;
+};
+
+#endif // SPOOLMONITOR_H
@@ -0,0 +1,186 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include "stallwatchdog.h"
+
+// A ping waits this long after the last answer, so a stall which begins
+// between pings is undercounted by at most as much.
+static const int pingInterval = 20;
+static const int pollInterval = 5;
+static const qint64 maxLogSize = 1 << 20;
+static const int logGenerations = 3;
+
+StallWatchdog::Scope::Scope(const char *operation)
+    : previous(NULL)
+{
+    QCoreApplication *app = QCoreApplication::instance();
+    active = app && QThread::currentThread() == app->thread();
+    if (active)
+        previous = StallWatchdog::instance()->operation.fetchAndStoreRelease(operation);
+}
+
+StallWatchdog::Scope::~Scope()
+{
+    if (active)
+        StallWatchdog::instance()->operation.storeRelease(previous);
+}
+
+
+
+StallWatchdog *StallWatchdog::instance()
+{
+    static StallWatchdog watchdog;
+    return &watchdog;
+}
+
+StallWatchdog::StallWatchdog()
+    : operation(NULL), answered(0), answeredAt(0), stopping(0), threshold_(50),
+      stalls(0), stalledMsecs(0)
+{
+    clock.start();
+    setLogFile(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+               + "/stalls.log");
+}
+
+StallWatchdog::~StallWatchdog()
+{
+    stopWatching();
+}
+
+void StallWatchdog::setThreshold(int msecs)
+{
+    threshold_.store(qMax(1, msecs));
+}
+
+int StallWatchdog::threshold() const
+{
+    return threshold_.load();
+}
+
+void StallWatchdog::setLogFile(const QString &filename)
+{
+    if (isRunning())
+        return;
+    log.setFileName(filename);
+}
+
+QString StallWatchdog::logFile() const
+{
+    return log.fileName();
+}
+
+void StallWatchdog::startWatching()
+{
+    if (isRunning())
+        return;
+    QDir().mkpath(QFileInfo(log.fileName()).absolutePath());
+    stopping.store(0);
+    start(QThread::HighPriority);
+}
+
+void StallWatchdog::stopWatching()
+{
+    if (!isRunning())
+        return;
+    stopping.store(1);
+    wait();
+    // The session's totals close its part of the log.
+    QJsonObject json;
+    json["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    json["session"] = summary();
+    writeLine(json);
+    log.close();
+}
+
+QJsonObject StallWatchdog::summary() const
+{
+    QMutexLocker lock(&mutex);
+    QJsonObject operations;
+    for (auto t = totals.constBegin(); t != totals.constEnd(); ++t) {
+        QJsonObject o;
+        o["count"] = t.value().count;
+        o["total_ms"] = double(t.value().msecs);
+        o["longest_ms"] = double(t.value().longest);
+        operations[t.key()] = o;
+    }
+    QJsonObject r;
+    r["threshold_ms"] = threshold_.load();
+    r["stalls"] = stalls;
+    r["stalled_ms"] = double(stalledMsecs);
+    r["operations"] = operations;
+    return r;
+}
+
+void StallWatchdog::run()
+{
+    int sequence = answered.load();
+    while (!stopping.load()) {
+        sequence++;
+        qint64 sent = clock.elapsed();
+        const char *during = NULL;
+        QMetaObject::invokeMethod(this, "pong", Qt::QueuedConnection,
+                                  Q_ARG(int, sequence));
+        while (answered.loadAcquire() != sequence && !stopping.load()) {
+            msleep(pollInterval);
+            // What the GUI thread is stuck in can only be asked while it is
+            // stuck; afterwards its scope is gone.
+            if (!during && clock.elapsed() - sent >= threshold_.load())
+                during = operation.loadAcquire();
+        }
+        if (stopping.load())
+            break;
+        qint64 waited = answeredAt.load() - sent;
+        if (waited >= threshold_.load())
+            record(waited, during);
+        msleep(pingInterval);
+    }
+}
+
+void StallWatchdog::pong(int sequence)
+{
+    answeredAt.store(clock.elapsed());
+    answered.storeRelease(sequence);
+}
+
+void StallWatchdog::record(qint64 msecs, const char *operation)
+{
+    // Nothing marked means the event loop itself: painting, layout, or a
+    // slot nobody has tagged yet.
+    QString name = operation ? QString::fromLatin1(operation)
+                             : QString("event loop");
+    {
+        QMutexLocker lock(&mutex);
+        Total &t = totals[name];
+        t.count++;
+        t.msecs += msecs;
+        t.longest = qMax(t.longest, msecs);
+        stalls++;
+        stalledMsecs += msecs;
+    }
+    QJsonObject json;
+    json["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    json["ms"] = double(msecs);
+    json["operation"] = name;
+    writeLine(json);
+}
+
+void StallWatchdog::writeLine(const QJsonObject &json)
+{
+    if (log.isOpen() && log.size() >= maxLogSize) {
+        log.close();
+        QString base = log.fileName();
+        QFile::remove(QString("%1.%2").arg(base).arg(logGenerations - 1));
+        for (int i = logGenerations - 2; i >= 1; i--)
+            QFile::rename(QString("%1.%2").arg(base).arg(i),
+                          QString("%1.%2").arg(base).arg(i + 1));
+        QFile::rename(base, base + ".1");
+    }
+    if (!log.isOpen() && !log.open(QFile::WriteOnly | QFile::Append | QFile::Text))
+        return;
+    log.write(QJsonDocument(json).toJson(QJsonDocument::Compact) + '\n');
+    log.flush();
+}
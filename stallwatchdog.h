@@ -0,0 +1,74 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+
+// Times how long the GUI thread takes to answer.  A thread of its own posts a
+// ping to the event loop every few milliseconds; an answer later than the
+// threshold is a stall, and is put down to whatever Scope the GUI thread was
+// inside while it was late.  Stalls go to a log which is rotated as it grows,
+// and are totalled per operation for the session.
+class StallWatchdog : public QThread {
+    Q_OBJECT
+public:
+    // Marks a GUI entry point for the time it runs.  Scopes nest; the
+    // innermost one takes the blame.  Anywhere but the GUI thread it does
+    // nothing.
+    class Scope {
+    public:
+        explicit Scope(const char *operation);
+        ~Scope();
+    private:
+        const char *previous;
+        bool active;
+    };
+
+    static StallWatchdog *instance();
+
+    void setThreshold(int msecs);
+    int threshold() const;
+    void setLogFile(const QString &filename);
+    QString logFile() const;
+    void startWatching();
+    void stopWatching();
+    QJsonObject summary() const;
+
+protected:
+    void run();
+
+private slots:
+    void pong(int sequence);
+
+private:
+    struct Total {
+        int count;
+        qint64 msecs;
+        qint64 longest;
+    };
+
+    StallWatchdog();
+    ~StallWatchdog();
+    void record(qint64 msecs, const char *operation);
+    void writeLine(const QJsonObject &json);
+
+    QAtomicPointer<const char> operation;
+    QAtomicInt answered;
+    QAtomicInteger<qint64> answeredAt;
+    QAtomicInt stopping;
+    QAtomicInt threshold_;
+    QElapsedTimer clock;
+    QFile log;
+    mutable QMutex mutex;
+    QHash<QString, Total> totals;
+    int stalls;
+    qint64 stalledMsecs;
+};
+
+#endif // STALLWATCHDOG_H
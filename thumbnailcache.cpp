@@ -0,0 +1,167 @@
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QUrl>
+#include "thumbnailcache.h"
+#include "memorybudget.h"
+#include "tiledimage.h"
+
+static const int maxQueued = 256;
+
+static QString thumbnailUri(const QString &filename)
+{
+    return QString::fromLatin1(
+                QUrl::fromLocalFile(QFileInfo(filename).absoluteFilePath()).toEncoded());
+}
+
+static QImage readThumbnail(const QString &filename)
+{
+    QFileInfo info(filename);
+    QString uri = thumbnailUri(filename);
+    QString cached = ThumbnailCache::thumbnailFilename(filename);
+
+    // A cached thumbnail is only good for the file it was made from.
+    QImage thumb(cached);
+    if (!thumb.isNull() && thumb.text("Thumb::URI") == uri
+            && thumb.text("Thumb::MTime").toLongLong()
+               == info.lastModified().toMSecsSinceEpoch() / 1000)
+        return thumb;
+
+    QImageReader reader(filename);
+    reader.setAutoTransform(true);
+    QSize size = reader.size();
+    if (!size.isValid())
+        return QImage();
+    QSize box(ThumbnailCache::ThumbnailSize, ThumbnailCache::ThumbnailSize);
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        if (size.width() > box.width() || size.height() > box.height())
+            reader.setScaledSize(size.scaled(box, Qt::KeepAspectRatio));
+    } else if (TiledImage::wanted(size)) {
+        return QImage();
+    }
+    thumb = reader.read();
+    if (thumb.isNull())
+        return QImage();
+    if (thumb.width() > box.width() || thumb.height() > box.height())
+        thumb = thumb.scaled(box, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    thumb.setText("Thumb::URI", uri);
+    thumb.setText("Thumb::MTime",
+                  QString::number(info.lastModified().toMSecsSinceEpoch() / 1000));
+    thumb.setText("Thumb::Size", QString::number(info.size()));
+    thumb.setText("Thumb::Image::Width", QString::number(size.width()));
+    thumb.setText("Thumb::Image::Height", QString::number(size.height()));
+    thumb.setText("Software", "darkcropper");
+
+    QDir folder = QFileInfo(cached).dir();
+    if (!folder.exists()) {
+        folder.mkpath(".");
+        QFile::setPermissions(folder.absolutePath(), QFile::ReadOwner
+                              | QFile::WriteOwner | QFile::ExeOwner);
+    }
+    QSaveFile out(cached);
+    if (out.open(QFile::WriteOnly) && thumb.save(&out, "PNG") && out.commit())
+        QFile::setPermissions(cached, QFile::ReadOwner | QFile::WriteOwner);
+    return thumb;
+}
+
+
+
+class ThumbnailTask : public QRunnable {
+public:
+    ThumbnailTask(ThumbnailCache *owner, const QString &filename)
+        : owner(owner), filename(filename) {}
+
+    void run()
+    {
+        QImage thumb = readThumbnail(filename);
+        QMetaObject::invokeMethod(owner, "generated", Qt::QueuedConnection,
+                                  Q_ARG(QString, filename), Q_ARG(QImage, thumb));
+    }
+
+private:
+    ThumbnailCache *owner;
+    QString filename;
+};
+
+
+
+ThumbnailCache *ThumbnailCache::instance()
+{
+    static ThumbnailCache cache;
+    return &cache;
+}
+
+ThumbnailCache::ThumbnailCache()
+{
+    pool.setMaxThreadCount(2);
+    images.setMaxCost(32 << 10);
+    budgetId = MemoryBudget::instance()->add("Thumbnails", MemoryBudget::Cached,
+                                             [this]() { images.clear(); });
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    queue.clear();
+    pool.waitForDone();
+}
+
+QImage ThumbnailCache::thumbnail(const QString &filename)
+{
+    QImage *image = images.object(filename);
+    if (!image)
+        return QImage();
+    MemoryBudget::instance()->touch(budgetId);
+    return *image;
+}
+
+void ThumbnailCache::request(const QStringList &filenames)
+{
+    // Later requests go to the front; whatever falls off the end was asked
+    // for long enough ago that nobody is looking at it any more.
+    for (int i = filenames.count() - 1; i >= 0; i--) {
+        const QString &filename = filenames.at(i);
+        if (images.contains(filename) || inFlight.contains(filename)
+                || failed.contains(filename))
+            continue;
+        queue.removeOne(filename);
+        queue.prepend(filename);
+    }
+    while (queue.count() > maxQueued)
+        queue.removeLast();
+    startNext();
+}
+
+QString ThumbnailCache::thumbnailFilename(const QString &filename)
+{
+    QByteArray hash = QCryptographicHash::hash(thumbnailUri(filename).toLatin1(),
+                                               QCryptographicHash::Md5).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            + "/thumbnails/normal/" + QString::fromLatin1(hash) + ".png";
+}
+
+void ThumbnailCache::generated(QString filename, QImage thumbnail)
+{
+    inFlight.remove(filename);
+    if (thumbnail.isNull()) {
+        failed.insert(filename);
+    } else {
+        images.insert(filename, new QImage(thumbnail), thumbnail.byteCount() >> 10);
+        MemoryBudget::instance()->resize(budgetId, qint64(images.totalCost()) << 10);
+        emit thumbnailReady(filename);
+    }
+    startNext();
+}
+
+void ThumbnailCache::startNext()
+{
+    while (!queue.isEmpty() && inFlight.count() < pool.maxThreadCount()) {
+        QString filename = queue.takeFirst();
+        inFlight.insert(filename);
+        pool.start(new ThumbnailTask(this, filename));
+    }
+}
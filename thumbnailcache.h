@@ -0,0 +1,48 @@
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+
+// Thumbnails for the filmstrips, kept in the freedesktop.org thumbnail cache
+// (~/.cache/thumbnails/normal) so that they survive the session and are shared
+// with file managers.  Missing thumbnails are made on a small pool with
+// reduced-resolution decoding where the format allows it.  The most recently
+// requested files are served first, and the backlog is bounded so that fast
+// scrolling through a long queue does not pile up work.
+class ThumbnailCache : public QObject {
+    Q_OBJECT
+public:
+    enum { ThumbnailSize = 128 };
+
+    static ThumbnailCache *instance();
+
+    QImage thumbnail(const QString &filename);
+    void request(const QStringList &filenames);
+
+    static QString thumbnailFilename(const QString &filename);
+
+signals:
+    void thumbnailReady(QString filename);
+
+private slots:
+    void generated(QString filename, QImage thumbnail);
+
+private:
+    ThumbnailCache();
+    ~ThumbnailCache();
+    void startNext();
+
+    QThreadPool pool;
+    QCache<QString, QImage> images;
+    QStringList queue;
+    QSet<QString> inFlight;
+    QSet<QString> failed;
+    int budgetId;
+};
+
+#endif // THUMBNAILCACHE_H
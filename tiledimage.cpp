@@ -0,0 +1,232 @@
+#include <cmath>
+#include <QDir>
+#include <QImageReader>
+#include <QPainter>
+#include <QProcess>
+#include <QStandardPaths>
+#include "tiledimage.h"
+#include "memorybudget.h"
+#include "scratchmanager.h"
+
+// Bigger than this many decoded bytes and a source is tiled.  Qt itself
+// cannot hold more than 2^31 bytes in one QImage.
+qint64 TiledImage::threshold = qint64(1) << 30;
+
+static const int overviewSize = 2048;
+
+TiledImage::TiledImage(QObject *parent)
+    : QObject(parent), decoder(NULL), pixels(NULL)
+{
+    setCacheLimit(256 << 20);
+    budgetId = MemoryBudget::instance()->add("Image tiles", MemoryBudget::Cached,
+                                             [this]() { tiles.clear(); });
+}
+
+TiledImage::~TiledImage()
+{
+    close();
+    MemoryBudget::instance()->remove(budgetId);
+}
+
+QString TiledImage::cacheFolder()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + "/tiles";
+}
+
+bool TiledImage::wanted(const QSize &size)
+{
+    return qint64(size.width()) * size.height() * 4 > threshold;
+}
+
+void TiledImage::setThreshold(qint64 bytes)
+{
+    threshold = bytes;
+}
+
+bool TiledImage::open(const QString &filename)
+{
+    close();
+    QImageReader reader(filename);
+    size_ = reader.size();
+    if (!size_.isValid())
+        return false;
+    this->filename = filename;
+
+    // Formats which can decode at a reduced size give an overview at once;
+    // everything else waits for the full decode below.
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        reader.setScaledSize(size_.scaled(overviewSize, overviewSize,
+                                          Qt::KeepAspectRatio));
+        overview_ = reader.read();
+    }
+
+    QString folder = cacheFolder();
+    QDir().mkpath(folder);
+    rawFilename = ScratchManager::uniqueName(folder, "bgra");
+    overviewFilename = rawFilename.left(rawFilename.length() - 4) + "png";
+
+    decoder = new QProcess();
+    decoder->setProgram("convert");
+    decoder->setArguments({
+        filename + "[0]",
+        "-depth", "8",
+        "-write", "BGRA:" + rawFilename,
+        "-thumbnail", QString("%1x%1>").arg(overviewSize),
+        overviewFilename
+    });
+    connect(decoder, SIGNAL(finished(int)),
+            this, SLOT(decoder_finished(int)));
+    decoder->start();
+    return true;
+}
+
+void TiledImage::close()
+{
+    if (decoder) {
+        decoder->disconnect(this);
+        decoder->kill();
+        decoder->waitForFinished();
+        decoder->deleteLater();
+        decoder = NULL;
+    }
+    tiles.clear();
+    MemoryBudget::instance()->resize(budgetId, 0);
+    if (pixels) {
+        raw.unmap(pixels);
+        pixels = NULL;
+    }
+    raw.close();
+    if (!rawFilename.isEmpty())
+        QFile::remove(rawFilename);
+    if (!overviewFilename.isEmpty())
+        QFile::remove(overviewFilename);
+    rawFilename.clear();
+    overviewFilename.clear();
+    filename.clear();
+    overview_ = QImage();
+    size_ = QSize();
+}
+
+bool TiledImage::isOpen() const
+{
+    return !filename.isEmpty();
+}
+
+bool TiledImage::isReady() const
+{
+    return pixels != NULL;
+}
+
+QSize TiledImage::size() const
+{
+    return size_;
+}
+
+QImage TiledImage::overview() const
+{
+    return overview_;
+}
+
+void TiledImage::setCacheLimit(qint64 bytes)
+{
+    tiles.setMaxCost(bytes >> 10);
+}
+
+QImage TiledImage::tile(int column, int row)
+{
+    if (!pixels)
+        return QImage();
+    int columns = (size_.width() + TileSize - 1) / TileSize;
+    int key = row * columns + column;
+    if (QImage *cached = tiles.object(key)) {
+        MemoryBudget::instance()->touch(budgetId);
+        return *cached;
+    }
+
+    QRect r = QRect(column * TileSize, row * TileSize, TileSize, TileSize)
+            & QRect(QPoint(0, 0), size_);
+    if (r.isEmpty())
+        return QImage();
+    qint64 stride = qint64(size_.width()) * 4;
+    const uchar *first = pixels + r.top() * stride + r.left() * 4;
+    QImage view(first, r.width(), r.height(), stride, QImage::Format_ARGB32);
+    QImage t = view.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    tiles.insert(key, new QImage(t), t.byteCount() >> 10);
+    MemoryBudget::instance()->resize(budgetId, qint64(tiles.totalCost()) << 10);
+    return t;
+}
+
+QImage TiledImage::region(const QRect &rect)
+{
+    QRect r = rect & QRect(QPoint(0, 0), size_);
+    if (r.isEmpty() || !pixels)
+        return QImage();
+    QImage out(r.size(), QImage::Format_ARGB32_Premultiplied);
+    QPainter p(&out);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    pin(true);
+    for (int row = r.top() / TileSize; row <= r.bottom() / TileSize; row++)
+        for (int column = r.left() / TileSize; column <= r.right() / TileSize; column++)
+            p.drawImage(QPoint(column * TileSize, row * TileSize) - r.topLeft(),
+                        tile(column, row));
+    pin(false);
+    return out;
+}
+
+void TiledImage::paint(QPainter &p, const QPointF &origin)
+{
+    QTransform toDevice = p.combinedTransform();
+    qreal deviceScale = std::sqrt(std::abs(toDevice.determinant()));
+    bool useOverview = !pixels || (!overview_.isNull()
+            && deviceScale <= 1.5 * overview_.width() / size_.width());
+    if (useOverview) {
+        if (!overview_.isNull())
+            p.drawImage(QRectF(origin, QSizeF(size_)), overview_);
+        return;
+    }
+
+    // Only the tiles under the viewport are decoded and drawn.
+    QRectF device(0, 0, p.device()->width(), p.device()->height());
+    QRect visible = toDevice.inverted().mapRect(device)
+            .translated(-origin).toAlignedRect()
+            & QRect(QPoint(0, 0), size_);
+    if (visible.isEmpty())
+        return;
+    pin(true);
+    for (int row = visible.top() / TileSize; row <= visible.bottom() / TileSize; row++)
+        for (int column = visible.left() / TileSize; column <= visible.right() / TileSize; column++)
+            p.drawImage(origin + QPointF(column * TileSize, row * TileSize),
+                        tile(column, row));
+    pin(false);
+}
+
+void TiledImage::pin(bool pinned)
+{
+    // Tiles cut for the pass under way are not thrown out by the next one;
+    // only once it is done do they compete with everything else again.
+    MemoryBudget::instance()->setPriority(budgetId, pinned ? MemoryBudget::Current
+                                                           : MemoryBudget::Cached);
+}
+
+void TiledImage::decoder_finished(int exitCode)
+{
+    decoder->deleteLater();
+    decoder = NULL;
+    qint64 expected = qint64(size_.width()) * size_.height() * 4;
+    raw.setFileName(rawFilename);
+    if (exitCode || !raw.open(QFile::ReadOnly) || raw.size() < expected) {
+        raw.close();
+        emit failed();
+        return;
+    }
+    pixels = raw.map(0, expected);
+    if (overview_.isNull())
+        overview_.load(overviewFilename);
+    if (!pixels) {
+        raw.close();
+        emit failed();
+        return;
+    }
+    emit ready();
+}
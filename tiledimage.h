@@ -0,0 +1,63 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QObject>
+#include <QCache>
+#include <QFile>
+#include <QImage>
+
+class QPainter;
+class QProcess;
+
+// Backing store for sources too large to decode into a single QImage.
+// ImageMagick decodes the file once into a raw scratch file, which is mapped
+// and cut into tiles on demand; recently used tiles stay in a bounded cache.
+class TiledImage : public QObject {
+    Q_OBJECT
+public:
+    enum { TileSize = 256 };
+
+    TiledImage(QObject *parent = 0);
+    ~TiledImage();
+
+    static bool wanted(const QSize &size);
+    static void setThreshold(qint64 bytes);
+    static QString cacheFolder();
+
+    bool open(const QString &filename);
+    void close();
+    bool isOpen() const;
+    bool isReady() const;
+    QSize size() const;
+    QImage overview() const;
+    void setCacheLimit(qint64 bytes);
+
+    QImage tile(int column, int row);
+    QImage region(const QRect &rect);
+    void paint(QPainter &p, const QPointF &origin);
+
+signals:
+    void ready();
+    void failed();
+
+private slots:
+    void decoder_finished(int exitCode);
+
+private:
+    void pin(bool pinned);
+
+    static qint64 threshold;
+
+    QString filename;
+    QSize size_;
+    QImage overview_;
+    QProcess *decoder;
+    QString rawFilename;
+    QString overviewFilename;
+    QFile raw;
+    uchar *pixels;
+    QCache<int, QImage> tiles;
+    int budgetId;
+};
+
+#endif // TILEDIMAGE_H
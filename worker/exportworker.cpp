@@ -0,0 +1,194 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QProcess>
+#include <QTextStream>
+#include <QThread>
+#include "exportworker.h"
+#include "exportindex.h"
+
+// A worker that has not beaten for this long is presumed dead and its claims
+// go back to the queue.
+static const int staleSecs = 60;
+static const int beatMsecs = 5000;
+
+ExportWorker::ExportWorker(const QString &spoolFolder, QObject *parent)
+    : QObject(parent), spool(spoolFolder), name(ExportSpool::workerName()),
+      convert("convert"), concurrency(1), memoryLimit(0), drain(false),
+      done(0), failed(0)
+{
+    // Notifications do not cross hosts on most network filesystems, so the
+    // watcher only makes local submissions snappier; polling does the rest.
+    connect(&watcher, &QFileSystemWatcher::directoryChanged,
+            this, &ExportWorker::poll);
+    connect(&pollTimer, &QTimer::timeout, this, &ExportWorker::poll);
+    connect(&beatTimer, &QTimer::timeout, this, &ExportWorker::beat);
+    pollTimer.setInterval(1000);
+    beatTimer.setInterval(beatMsecs);
+}
+
+ExportWorker::~ExportWorker()
+{
+    for (QProcess *p : running.keys()) {
+        p->disconnect(this);
+        p->kill();
+        p->waitForFinished();
+        delete p;
+    }
+    spool.retire(name);
+}
+
+void ExportWorker::setConcurrency(int jobs)
+{
+    concurrency = qMax(1, jobs);
+}
+
+void ExportWorker::setMemoryLimit(qint64 bytes)
+{
+    memoryLimit = bytes;
+}
+
+void ExportWorker::setDrain(bool drain)
+{
+    this->drain = drain;
+}
+
+void ExportWorker::setConvert(const QString &program)
+{
+    convert = program;
+}
+
+bool ExportWorker::start()
+{
+    if (!spool.create())
+        return false;
+    watcher.addPath(spool.folder() + "/new");
+    pollTimer.start();
+    beatTimer.start();
+    beat();
+    QTimer::singleShot(0, this, SLOT(poll()));
+    return true;
+}
+
+void ExportWorker::poll()
+{
+    spool.requeueStale(staleSecs);
+    while (running.count() < concurrency) {
+        ExportSpool::Claim claim;
+        if (!spool.claim(name, &claim))
+            break;
+        // Each worker decides its own memory ceiling; the GUI's is meaningless
+        // on another host.
+        claim.job.memoryLimit = memoryLimit;
+        QProcess *p = new QProcess(this);
+        p->setProgram(convert);
+        p->setArguments(claim.job.convertArguments());
+        p->setProcessChannelMode(QProcess::SeparateChannels);
+        connect(p, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+                this, [this, p](int exitCode, QProcess::ExitStatus status) {
+            process_finished(p, status == QProcess::CrashExit ? -1 : exitCode);
+        });
+        connect(p, &QProcess::errorOccurred, this, [this, p](QProcess::ProcessError e) {
+            if (e == QProcess::FailedToStart)
+                process_finished(p, -1);
+        });
+        Running r;
+        r.claim = claim;
+        r.timer.start();
+        running.insert(p, r);
+        p->start();
+    }
+    if (drain && running.isEmpty() && spool.waiting() == 0)
+        emit finished();
+}
+
+void ExportWorker::beat()
+{
+    QJsonArray jobs;
+    for (const Running &r : running)
+        jobs << r.claim.id;
+    QJsonObject state;
+    state["running"] = jobs;
+    state["concurrency"] = concurrency;
+    state["done"] = done;
+    state["failed"] = failed;
+    spool.heartbeat(name, state);
+}
+
+void ExportWorker::process_finished(QProcess *process, int exitCode)
+{
+    auto it = running.find(process);
+    if (it == running.end())
+        return;
+    Running r = *it;
+    running.erase(it);
+
+    QJsonObject result;
+    result["worker"] = name;
+    result["exit_code"] = exitCode;
+    result["ms"] = double(r.timer.elapsed());
+    result["stderr"] = QString::fromLocal8Bit(process->readAllStandardError()).trimmed();
+    bool ok = exitCode == 0;
+    QString error;
+    if (ok && !r.claim.job.verifyOutput(&error)) {
+        result["verify"] = error;
+        ok = false;
+    }
+    // Whatever convert wrote is not the export, and would keep the watch
+    // folder from ever offering the source again.
+    if (!ok)
+        QFile::remove(r.claim.job.outputFilename);
+    if (ok)
+        ExportIndex::forFolder(QFileInfo(r.claim.job.outputFilename).absolutePath())
+                ->record(r.claim.job);
+    spool.finish(r.claim, ok, result);
+    if (ok)
+        done++;
+    else
+        failed++;
+    QTextStream(stderr) << r.claim.id << (ok ? " done " : " failed ")
+                        << r.claim.job.outputFilename << endl;
+    process->deleteLater();
+    QTimer::singleShot(0, this, SLOT(poll()));
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("darkcropper-worker");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders darkcropper exports from a spool folder.");
+    parser.addHelpOption();
+    QCommandLineOption spoolOption("spool", "Spool folder to work from.", "folder");
+    QCommandLineOption jobsOption({"j", "jobs"},
+            "Number of exports to run at once.", "n",
+            QString::number(qMax(1, QThread::idealThreadCount() / 2)));
+    QCommandLineOption memoryOption("memory",
+            "Memory limit per export, in MiB (0 lets convert decide).", "mib", "0");
+    QCommandLineOption drainOption("drain",
+            "Exit once the spool is empty instead of waiting for more.");
+    QCommandLineOption convertOption("convert",
+            "The imagemagick convert to run.", "program", "convert");
+    parser.addOptions({ spoolOption, jobsOption, memoryOption, drainOption,
+                        convertOption });
+    parser.process(a);
+    if (!parser.isSet(spoolOption))
+        parser.showHelp(1);
+
+    ExportWorker worker(parser.value(spoolOption));
+    worker.setConcurrency(parser.value(jobsOption).toInt());
+    worker.setMemoryLimit(parser.value(memoryOption).toLongLong() << 20);
+    worker.setDrain(parser.isSet(drainOption));
+    worker.setConvert(parser.value(convertOption));
+    QObject::connect(&worker, &ExportWorker::finished, &a, &QCoreApplication::quit);
+    if (!worker.start()) {
+        QTextStream(stderr) << "could not use spool " << parser.value(spoolOption) << endl;
+        return 1;
+    }
+    return a.exec();
+}
@@ -0,0 +1,54 @@
+#ifndef EXPORTWORKER_H
+#define EXPORTWORKER_H
+
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+#include "exportspool.h"
+
+class QProcess;
+
+// Claims manifests from an ExportSpool and runs convert on them, up to a
+// fixed number at a time, heart-beating into the spool while it lives.
+class ExportWorker : public QObject {
+    Q_OBJECT
+public:
+    ExportWorker(const QString &spoolFolder, QObject *parent = 0);
+    ~ExportWorker();
+    void setConcurrency(int jobs);
+    void setMemoryLimit(qint64 bytes);
+    void setDrain(bool drain);
+    void setConvert(const QString &program);
+    bool start();
+
+signals:
+    void finished();
+
+private slots:
+    void poll();
+    void beat();
+    void process_finished(QProcess *process, int exitCode);
+
+private:
+    struct Running {
+        ExportSpool::Claim claim;
+        QElapsedTimer timer;
+    };
+
+    ExportSpool spool;
+    QString name;
+    QString convert;
+    int concurrency;
+    qint64 memoryLimit;
+    bool drain;
+    int done;
+    int failed;
+    QHash<QProcess*, Running> running;
+    QFileSystemWatcher watcher;
+    QTimer pollTimer;
+    QTimer beatTimer;
+};
+
+#endif // EXPORTWORKER_H
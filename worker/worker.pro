@@ -0,0 +1,15 @@
+# Renders export manifests from a spool folder; run as many as you like, on
+# this host or any other that sees the same folder.
+#   ./darkcropper-worker --spool /srv/darkcropper-spool --jobs 4
+
+TARGET = darkcropper-worker
+TEMPLATE = app
+QT = core
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../core.pri)
+
+SOURCES += exportworker.cpp
+
+HEADERS += exportworker.h